@@ -0,0 +1,1178 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <memory_resource>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <filesystem>
+#include <numeric>
+#include <deque>
+
+#include "forest.hpp"
+#include "eulerforest.hpp"
+#include "frozenforest.hpp"
+#include "indexforest.hpp"
+#include "lcaindex.hpp"
+#include "parallelforest.hpp"
+#include "snapshotforest.hpp"
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+double ns_per_op(clock_type::time_point start, clock_type::time_point finish, size_t ops)
+{
+    std::chrono::duration<double, std::nano> spent = finish - start;
+    return spent.count() / ops;
+}
+
+// random forest: parent of every new node is one of the previous ones
+// (or the header), so erasing in reverse order always erases leaves
+void bench_insert_erase(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+
+    std::mt19937 gen(seed);
+    std::vector<size_t> parents(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        parents[i] = std::uniform_int_distribution<size_t>(0, i)(gen);
+    }
+
+    auto start = clock_type::now();
+    for (size_t i = 0; i < size; ++i)
+    {
+        nodes.push_back(forest.insert(nodes[parents[i]], static_cast<long>(i)));
+    }
+    auto inserted = clock_type::now();
+    for (size_t i = size; i > 0; --i)
+    {
+        forest.erase(nodes[i]);
+    }
+    auto erased = clock_type::now();
+
+    std::cout << "insert: " << ns_per_op(start, inserted, size) << " ns/node, "
+              << "erase: " << ns_per_op(inserted, erased, size) << " ns/node" << std::endl;
+}
+
+// steady state: a leaf goes away, a new one comes
+void bench_churn(size_t size, size_t ops, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> leaves;
+    leaves.reserve(size);
+    auto root = forest.insert(forest.end(), 0);
+    for (size_t i = 0; i < size; ++i)
+    {
+        leaves.push_back(forest.insert(root, static_cast<long>(i)));
+    }
+
+    std::mt19937 gen(seed);
+    auto start = clock_type::now();
+    for (size_t i = 0; i < ops; ++i)
+    {
+        auto& victim = leaves[std::uniform_int_distribution<size_t>(0, size - 1)(gen)];
+        forest.erase(victim);
+        victim = forest.insert(root, static_cast<long>(i));
+    }
+    auto finish = clock_type::now();
+
+    std::cout << "churn: " << ns_per_op(start, finish, ops) << " ns/(erase + insert)" << std::endl;
+}
+
+// erasing roots: every one of them is an internal node
+// until the forest gets flat
+void bench_erase_roots(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+
+    auto start = clock_type::now();
+    while (!forest.empty())
+    {
+        forest.erase(forest.begin());
+    }
+    auto finish = clock_type::now();
+
+    std::cout << "erase from the front: " << ns_per_op(start, finish, size) << " ns/node" << std::endl;
+}
+
+// snapshots: whole forest copy
+void bench_copy(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+
+    auto start = clock_type::now();
+    auto copy = forest;
+    auto finish = clock_type::now();
+
+    std::cout << "copy: " << ns_per_op(start, finish, size) << " ns/node"
+              << (copy == forest ? "" : " (wrong copy)") << std::endl;
+}
+
+// teardown of a whole forest
+template<typename T>
+void bench_clear(size_t size, unsigned seed, const char* name)
+{
+    forestlib::forest<T> forest;
+    std::vector<typename forestlib::forest<T>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], T()));
+    }
+
+    auto start = clock_type::now();
+    forest.clear();
+    auto finish = clock_type::now();
+
+    std::cout << "clear<" << name << ">: " << ns_per_op(start, finish, size) << " ns/node" << std::endl;
+}
+
+// forests built per request: default heap against an arena
+// that is thrown away in one shot
+template<typename Forest, typename... Alloc>
+void build_and_drop(size_t size, const std::vector<size_t>& parents, Alloc&&... alloc)
+{
+    Forest forest(alloc...);
+    std::vector<typename Forest::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    for (size_t i = 0; i < size; ++i)
+    {
+        nodes.push_back(forest.insert(nodes[parents[i]], static_cast<long>(i)));
+    }
+}
+
+void bench_requests(size_t size, size_t requests, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::vector<size_t> parents(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        parents[i] = std::uniform_int_distribution<size_t>(0, i)(gen);
+    }
+
+    auto start = clock_type::now();
+    for (size_t i = 0; i < requests; ++i)
+    {
+        build_and_drop<forestlib::forest<long>>(size, parents);
+    }
+    auto heap = clock_type::now();
+    std::vector<unsigned char> buffer(64 * size + 4096);
+    for (size_t i = 0; i < requests; ++i)
+    {
+        std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+        build_and_drop<forestlib::pmr::forest<long>>(size, parents, &arena);
+    }
+    auto arena = clock_type::now();
+
+    std::cout << "request forest (" << size << " nodes) default: "
+              << ns_per_op(start, heap, requests * size) << " ns/node, "
+              << "monotonic arena: " << ns_per_op(heap, arena, requests * size) << " ns/node" << std::endl;
+}
+
+// read-only sweeps: linked nodes against frozen arrays
+void bench_frozen(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+
+    auto sweep = [] (const auto& any_forest)
+    {
+        long sum = 0;
+        for (auto it = any_forest.begin(); it != any_forest.end(); ++it)
+        {
+            sum += *it * any_forest.get_level(it);
+        }
+        return sum;
+    };
+
+    auto start = clock_type::now();
+    auto linked_sum = sweep(forest);
+    auto linked = clock_type::now();
+    auto frozen = forest.freeze();
+    auto frozen_at = clock_type::now();
+    auto frozen_sum = sweep(frozen);
+    auto swept = clock_type::now();
+
+    std::cout << "pre-order sweep: " << ns_per_op(start, linked, size) << " ns/node, "
+              << "freeze: " << ns_per_op(linked, frozen_at, size) << " ns/node, "
+              << "frozen sweep: " << ns_per_op(frozen_at, swept, size) << " ns/node"
+              << (linked_sum == frozen_sum ? "" : " (wrong sum)") << std::endl;
+}
+
+// building with long strings: copies, moves and in-place construction
+void bench_strings(size_t size, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::vector<size_t> parents(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        parents[i] = std::uniform_int_distribution<size_t>(0, i)(gen);
+    }
+    const std::string value(64, 'x');
+
+    auto build = [&] (auto add)
+    {
+        forestlib::forest<std::string> forest;
+        std::vector<forestlib::forest<std::string>::iterator> nodes;
+        nodes.reserve(size + 1);
+        nodes.push_back(forest.end());
+        auto start = clock_type::now();
+        for (size_t i = 0; i < size; ++i)
+        {
+            nodes.push_back(add(forest, nodes[parents[i]]));
+        }
+        return ns_per_op(start, clock_type::now(), size);
+    };
+
+    auto copied = build([&] (auto& forest, auto pos)
+    {
+        std::string tmp(64, 'x');
+        return forest.insert(pos, tmp);
+    });
+    auto moved = build([&] (auto& forest, auto pos)
+    {
+        std::string tmp(64, 'x');
+        return forest.insert(pos, std::move(tmp));
+    });
+    auto emplaced = build([&] (auto& forest, auto pos)
+    {
+        return forest.emplace(pos, value.size(), 'x');
+    });
+
+    std::cout << "insert<string> copy: " << copied << " ns/node, "
+              << "move: " << moved << " ns/node, "
+              << "emplace: " << emplaced << " ns/node" << std::endl;
+}
+
+// parser output: (level, value) pairs in pre-order
+void bench_preorder(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+    std::vector<std::pair<unsigned, long>> input;
+    input.reserve(size);
+    for (auto it = forest.begin(); it != forest.end(); ++it)
+    {
+        input.emplace_back(forest.get_level(it), *it);
+    }
+
+    // best of two: the first one also pays for fresh pages
+    auto best_of_two = [&] (auto build)
+    {
+        double best = 0;
+        for (int run = 0; run < 2; ++run)
+        {
+            auto start = clock_type::now();
+            auto built = build();
+            auto spent = ns_per_op(start, clock_type::now(), size);
+            best = run == 0 ? spent : std::min(best, spent);
+            if (built != forest)
+            {
+                std::cout << "(wrong forest) ";
+            }
+        }
+        return best;
+    };
+
+    auto one_by_one = best_of_two([&]
+    {
+        // the way it is done without assign_preorder
+        forestlib::forest<long> inserted;
+        std::vector<forestlib::forest<long>::iterator> path;
+        for (const auto& [level, value] : input)
+        {
+            path.erase(path.begin() + (level - 1), path.end());
+            path.push_back(inserted.insert(level > 1 ? path[level - 2] : inserted.end(), value));
+        }
+        return inserted;
+    });
+    auto sequential = best_of_two([&]
+    {
+        return forestlib::forest<long>(input.begin(), input.end());
+    });
+    auto parallel = best_of_two([&]
+    {
+        forestlib::forest<long> assigned;
+        assigned.assign_preorder_parallel(input.begin(), input.end());
+        return assigned;
+    });
+
+    std::cout << "from pre-order insert: " << one_by_one << " ns/node, "
+              << "assign: " << sequential << " ns/node, "
+              << "parallel (" << std::thread::hardware_concurrency() << " threads): "
+              << parallel << " ns/node" << std::endl;
+}
+
+// through a file, so that the disk cache is in, but not the forest
+void bench_save_load(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+
+    auto path = std::filesystem::temp_directory_path() / "benchforest.bin";
+    auto start = clock_type::now();
+    {
+        std::ofstream out(path, std::ios::binary);
+        forest.save(out);
+    }
+    auto saved = ns_per_op(start, clock_type::now(), size);
+    auto bytes = static_cast<double>(std::filesystem::file_size(path)) / std::max<size_t>(size, 1);
+
+    // best of two: the first one also pays for fresh pages
+    double loaded = 0;
+    for (int run = 0; run < 2; ++run)
+    {
+        forestlib::forest<long> read;
+        start = clock_type::now();
+        std::ifstream in(path, std::ios::binary);
+        read.load(in);
+        auto spent = ns_per_op(start, clock_type::now(), size);
+        loaded = run == 0 ? spent : std::min(loaded, spent);
+        if (read != forest)
+        {
+            std::cout << "(wrong forest) ";
+        }
+    }
+    std::filesystem::remove(path);
+
+    std::cout << "save: " << saved << " ns/node, "
+              << "load: " << loaded << " ns/node, "
+              << bytes << " bytes/node on disk" << std::endl;
+}
+
+// start-up of a mapped image against loading the same nodes,
+// then a sweep over each
+void bench_mapped(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+
+    auto start = clock_type::now();
+    forestlib::index_forest<long> indexed(forest);
+    auto converted = ns_per_op(start, clock_type::now(), size);
+
+    auto image = std::filesystem::temp_directory_path() / "benchforest.img";
+    auto stream = std::filesystem::temp_directory_path() / "benchforest.bin";
+    {
+        std::ofstream out(image, std::ios::binary);
+        indexed.write(out);
+    }
+    {
+        std::ofstream out(stream, std::ios::binary);
+        forest.save(out);
+    }
+
+    start = clock_type::now();
+    forestlib::mapped_forest<long> mapped(image.c_str());
+    auto opened = std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+
+    start = clock_type::now();
+    {
+        forestlib::forest<long> loaded;
+        std::ifstream in(stream, std::ios::binary);
+        loaded.load(in);
+    }
+    auto loaded = std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+
+    auto sweep = [size] (const auto& any_forest, double& spent)
+    {
+        long sum = 0;
+        auto start = clock_type::now();
+        for (auto it = any_forest.begin(); it != any_forest.end(); ++it)
+        {
+            sum += *it;
+        }
+        spent = ns_per_op(start, clock_type::now(), size);
+        return sum;
+    };
+    double mapped_sweep, indexed_sweep, forest_sweep;
+    auto mapped_sum = sweep(mapped, mapped_sweep);
+    auto indexed_sum = sweep(indexed, indexed_sweep);
+    auto forest_sum = sweep(forest, forest_sweep);
+    if (mapped != indexed || mapped_sum != forest_sum || indexed_sum != forest_sum)
+    {
+        std::cout << "(wrong forest) ";
+    }
+    std::filesystem::remove(image);
+    std::filesystem::remove(stream);
+
+    std::cout << "index node: " << sizeof(forestlib::detail::index_node_t) << " bytes, "
+              << "index from forest: " << converted << " ns/node, "
+              << "map: " << opened << " us, load: " << loaded << " us, "
+              << "sweep mapped: " << mapped_sweep << " ns/node, "
+              << "index: " << indexed_sweep << " ns/node, "
+              << "forest: " << forest_sweep << " ns/node" << std::endl;
+}
+
+// some work per node, so that the walk is not all there is
+long busy(long value) noexcept
+{
+    for (int i = 0; i < 200; ++i)
+    {
+        value = value * 6364136223846793005L + 1442695040888963407L;
+    }
+    return value;
+}
+
+void bench_parallel(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+    auto sequential_one = forest;
+    auto parallel_one = forest;
+
+    auto start = clock_type::now();
+    for (auto& value : sequential_one)
+    {
+        value = busy(value);
+    }
+    auto sequential = ns_per_op(start, clock_type::now(), size);
+
+    auto& pool = forestlib::parallel::default_pool();
+    start = clock_type::now();
+    forestlib::parallel::for_each(parallel_one, [] (long& value) { value = busy(value); }, pool);
+    auto parallel = ns_per_op(start, clock_type::now(), size);
+
+    start = clock_type::now();
+    forestlib::parallel::transform(forest, parallel_one, busy, pool);
+    auto transformed = ns_per_op(start, clock_type::now(), size);
+
+    if (parallel_one != sequential_one)
+    {
+        std::cout << "(wrong forest) ";
+    }
+    std::cout << "busy nodes sequential: " << sequential << " ns/node, "
+              << "for_each (" << pool.size() << " threads): " << parallel << " ns/node, "
+              << "transform: " << transformed << " ns/node" << std::endl;
+
+    // subtree hashes, the fold on one thread is the sequential path
+    auto leaf_fn = [] (const long& value) { return busy(value); };
+    auto combine_fn = [] (long acc, long child) { return acc * 31 + child; };
+    forestlib::parallel::thread_pool single(1);
+    start = clock_type::now();
+    auto folded_alone = forestlib::parallel::reduce_subtrees(forest, leaf_fn, combine_fn, single);
+    auto alone = ns_per_op(start, clock_type::now(), size);
+    start = clock_type::now();
+    auto folded = forestlib::parallel::reduce_subtrees(forest, leaf_fn, combine_fn, pool);
+    auto together = ns_per_op(start, clock_type::now(), size);
+    if (folded != folded_alone)
+    {
+        std::cout << "(wrong fold) ";
+    }
+    std::cout << "reduce_subtrees 1 thread: " << alone << " ns/node, "
+              << pool.size() << " threads: " << together << " ns/node" << std::endl;
+}
+
+// subtree sums on the tour in a treap against walking the subtree,
+// then moving random subtrees under random nodes outside them
+void bench_euler(size_t size, size_t ops, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+
+    auto start = clock_type::now();
+    forestlib::euler_forest<long> tour(forest);
+    auto built = ns_per_op(start, clock_type::now(), size);
+    // both in pre-order
+    std::vector<forestlib::forest<long>::iterator> list_nodes;
+    std::vector<forestlib::euler_forest<long>::iterator> tour_nodes;
+    list_nodes.reserve(size);
+    tour_nodes.reserve(size);
+    for (auto it = forest.begin(); it != forest.end(); ++it)
+    {
+        list_nodes.push_back(it);
+    }
+    for (auto it = tour.begin(); it != tour.end(); ++it)
+    {
+        tour_nodes.push_back(it);
+    }
+
+    std::vector<size_t> picks(ops);
+    for (auto& pick : picks)
+    {
+        pick = gen() % size;
+    }
+
+    long walked_sum = 0;
+    start = clock_type::now();
+    for (auto pick : picks)
+    {
+        for (auto it = list_nodes[pick], last = list_nodes[pick].skip_subtree(); it != last; ++it)
+        {
+            walked_sum += *it;
+        }
+    }
+    auto walked = ns_per_op(start, clock_type::now(), ops);
+
+    long tour_sum = 0;
+    start = clock_type::now();
+    for (auto pick : picks)
+    {
+        tour_sum += tour.aggregate(tour_nodes[pick]);
+    }
+    auto aggregated = ns_per_op(start, clock_type::now(), ops);
+
+    // pages of a list view: a walk from the start each
+    // on the forest, so just a few of those
+    size_t list_ops = std::min<size_t>(ops, 100);
+    size_t ranks = 0;
+    start = clock_type::now();
+    for (size_t i = 0; i < list_ops; ++i)
+    {
+        ranks += std::distance(forest.begin(), std::next(forest.begin(), picks[i]));
+    }
+    auto listed = ns_per_op(start, clock_type::now(), list_ops);
+    size_t tour_ranks = 0;
+    start = clock_type::now();
+    for (size_t i = 0; i < ops; ++i)
+    {
+        tour_ranks += tour.rank(tour.nth(picks[i]));
+    }
+    auto ranked = ns_per_op(start, clock_type::now(), ops);
+    if (tour_ranks != std::accumulate(picks.begin(), picks.end(), size_t(0)) ||
+        ranks != std::accumulate(picks.begin(), picks.begin() + list_ops, size_t(0)))
+    {
+        std::cout << "(wrong ranks) ";
+    }
+    std::cout << "n-th node and its rank walked: " << listed << " ns, "
+              << "on euler_forest: " << ranked << " ns" << std::endl;
+
+    size_t moved = 0;
+    start = clock_type::now();
+    for (size_t i = 0; i < ops; ++i)
+    {
+        auto node = tour_nodes[gen() % size];
+        auto parent = gen() % 8 ? tour_nodes[gen() % size] : tour.end();
+        try
+        {
+            tour.move_subtree(node, parent);
+            ++moved;
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+    }
+    auto moving = ns_per_op(start, clock_type::now(), ops);
+
+    if (walked_sum != tour_sum)
+    {
+        std::cout << "(wrong sums) ";
+    }
+    std::cout << "euler_forest build: " << built << " ns/node, "
+              << "subtree sum walked: " << walked << " ns, aggregate: " << aggregated << " ns, "
+              << "move_subtree: " << moving << " ns (" << moved << " of " << ops << " moved)" << std::endl;
+}
+
+// lowest common ancestors of random pairs: climbing with parent()
+// against the index, by iterators and by indices in a batch
+void bench_lca(size_t size, size_t queries, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        // a window of recent parents, so that it is deep
+        auto parent = i - std::min<size_t>(i, gen() % 64);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+
+    std::vector<std::pair<size_t, size_t>> pairs(queries);
+    for (auto& pair : pairs)
+    {
+        pair = std::make_pair(1 + gen() % size, 1 + gen() % size);
+    }
+
+    auto climbed_lca = [&forest] (forestlib::forest<long>::iterator lhs, forestlib::forest<long>::iterator rhs)
+    {
+        while (forest.get_level(lhs) > forest.get_level(rhs))
+        {
+            lhs = lhs.parent();
+        }
+        while (forest.get_level(rhs) > forest.get_level(lhs))
+        {
+            rhs = rhs.parent();
+        }
+        while (lhs != rhs)
+        {
+            lhs = lhs.parent();
+            rhs = rhs.parent();
+        }
+        return lhs;
+    };
+    // deep as it is, just a few climbs
+    size_t climbs = std::min<size_t>(queries, 1000);
+    size_t climbed_roots = 0;
+    auto start = clock_type::now();
+    for (size_t i = 0; i < climbs; ++i)
+    {
+        climbed_roots += climbed_lca(nodes[pairs[i].first], nodes[pairs[i].second]) == forest.end();
+    }
+    auto climbed = ns_per_op(start, clock_type::now(), climbs);
+
+    start = clock_type::now();
+    forestlib::lca_index<forestlib::forest<long>> index(forest);
+    auto built = ns_per_op(start, clock_type::now(), size);
+
+    size_t indexed_roots = 0;
+    size_t indexed_some = 0;
+    start = clock_type::now();
+    for (size_t i = 0; i < queries; ++i)
+    {
+        indexed_roots += index.lca(nodes[pairs[i].first], nodes[pairs[i].second]) == forest.end();
+        if (i + 1 == climbs)
+        {
+            indexed_some = indexed_roots;
+        }
+    }
+    auto by_iterators = ns_per_op(start, clock_type::now(), queries);
+
+    std::vector<std::pair<size_t, size_t>> index_pairs;
+    index_pairs.reserve(queries);
+    for (auto& pair : pairs)
+    {
+        index_pairs.emplace_back(index.index_of(nodes[pair.first]), index.index_of(nodes[pair.second]));
+    }
+    std::vector<size_t> found(queries);
+    start = clock_type::now();
+    index.lca(index_pairs.begin(), index_pairs.end(), found.begin());
+    auto batched = ns_per_op(start, clock_type::now(), queries);
+
+    if (climbed_roots != indexed_some ||
+        static_cast<size_t>(std::count(found.begin(), found.end(), index.npos)) != indexed_roots)
+    {
+        std::cout << "(wrong ancestors) ";
+    }
+    std::cout << "lca climbed: " << climbed << " ns, index build: " << built << " ns/node, "
+              << "by iterators: " << by_iterators << " ns, by indices in a batch: " << batched << " ns" << std::endl;
+
+    // ancestors half way up, climbing against the index,
+    // one by one and sorted in a batch
+    forestlib::level_ancestor_index<forestlib::forest<long>> ancestors(forest);
+    std::vector<std::pair<size_t, forestlib::forest<long>::level_t>> level_queries;
+    level_queries.reserve(queries);
+    for (auto& pair : index_pairs)
+    {
+        level_queries.emplace_back(pair.first, (forest.get_level(nodes[0]) + ancestors.node(pair.first).level_ + 1) / 2);
+    }
+    size_t climbed_sum = 0;
+    start = clock_type::now();
+    for (size_t i = 0; i < climbs; ++i)
+    {
+        auto pos = ancestors.node(level_queries[i].first);
+        while (pos.level_ > level_queries[i].second)
+        {
+            pos = pos.parent();
+        }
+        climbed_sum += *pos;
+    }
+    auto climbed_up = ns_per_op(start, clock_type::now(), climbs);
+
+    size_t searched_sum = 0;
+    size_t searched_some = 0;
+    start = clock_type::now();
+    for (size_t i = 0; i < queries; ++i)
+    {
+        auto& query = level_queries[i];
+        searched_sum += *ancestors.node(ancestors.level_ancestor(query.first, query.second));
+        if (i + 1 == climbs)
+        {
+            searched_some = searched_sum;
+        }
+    }
+    auto searched = ns_per_op(start, clock_type::now(), queries);
+
+    std::sort(level_queries.begin(), level_queries.end());
+    std::vector<size_t> levelled(queries);
+    start = clock_type::now();
+    ancestors.level_ancestors(level_queries.begin(), level_queries.end(), levelled.begin());
+    auto swept = ns_per_op(start, clock_type::now(), queries);
+    size_t swept_sum = 0;
+    for (auto ancestor : levelled)
+    {
+        swept_sum += *ancestors.node(ancestor);
+    }
+
+    if (climbed_sum != searched_some || searched_sum != swept_sum)
+    {
+        std::cout << "(wrong level ancestors) ";
+    }
+    std::cout << "level ancestor climbed: " << climbed_up << " ns, searched: " << searched << " ns, "
+              << "sorted batch: " << swept << " ns" << std::endl;
+}
+
+// readers sweeping snapshots for a while, alone
+// and with the writer inserting, erasing and publishing meanwhile
+void bench_snapshot(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+    forestlib::snapshot_forest<long> snapshots(forest);
+
+    auto readers = std::max(1u, std::thread::hardware_concurrency() - 1);
+    auto read_for = [&snapshots, readers] (auto duration, auto write)
+    {
+        std::atomic<bool> done(false);
+        std::atomic<size_t> swept(0);
+        std::atomic<long> total(0);
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < readers; ++i)
+        {
+            threads.emplace_back([&snapshots, &done, &swept, &total]
+            {
+                long sum = 0;
+                while (!done.load(std::memory_order_relaxed))
+                {
+                    auto snapshot = snapshots.read();
+                    for (auto it = snapshot->begin(); it != snapshot->end(); ++it)
+                    {
+                        sum += *it;
+                    }
+                    swept += snapshot->size();
+                }
+                total += sum;
+            });
+        }
+        size_t published = 0;
+        auto start = clock_type::now();
+        while (clock_type::now() - start < duration)
+        {
+            published += write();
+        }
+        done = true;
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+        return std::make_pair(swept / seconds, published / seconds);
+    };
+
+    auto alone = read_for(std::chrono::milliseconds(300), []
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return 0;
+    });
+    auto& draft = snapshots.draft();
+    auto with_writes = read_for(std::chrono::milliseconds(300), [&draft, &snapshots, &gen]
+    {
+        // a batch of changes a version
+        for (int i = 0; i < 100; ++i)
+        {
+            auto pos = std::next(draft.begin(), gen() % 64);
+            if (gen() % 2)
+            {
+                draft.insert(pos, static_cast<long>(i));
+            }
+            else
+            {
+                draft.erase(pos);
+            }
+        }
+        snapshots.publish();
+        return 1;
+    });
+
+    std::cout << "snapshot reads (" << readers << " readers): " << alone.first / 1e6 << " Mnodes/s, "
+              << "while writing: " << with_writes.first / 1e6 << " Mnodes/s, "
+              << with_writes.second << " versions/s" << std::endl;
+}
+
+// level by level: a queue of iterators rebuilt for every walk
+// against the level-order view, all levels and the deepest one alone
+// (sums weigh values by position, so both must see the same order)
+void bench_level_order(size_t size, unsigned seed)
+{
+    using forest_t = forestlib::forest<long>;
+    forest_t forest;
+    std::vector<forest_t::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+    forest_t::level_t deepest = 0;
+    for (auto it = forest.begin(); it != forest.end(); ++it)
+    {
+        deepest = std::max(deepest, forest.get_level(it));
+    }
+
+    auto start = clock_type::now();
+    long queued_sum = 0;
+    long position = 0;
+    std::deque<forest_t::iterator> queue(1, forest.end());
+    for (; !queue.empty(); queue.pop_front())
+    {
+        auto children = forest.children(queue.front());
+        for (auto it = children.begin(); it != children.end(); ++it)
+        {
+            queued_sum += *it * ++position;
+            queue.push_back(it.base());
+        }
+    }
+    auto queued = clock_type::now();
+    long level_sum = 0;
+    position = 0;
+    for (auto value : forest.get_level_order())
+    {
+        level_sum += value * ++position;
+    }
+    auto leveled = clock_type::now();
+    size_t deepest_size = 0;
+    auto deepest_level = forest.get_level_order(deepest);
+    for (auto it = deepest_level.begin(); it != deepest_level.end(); ++it)
+    {
+        ++deepest_size;
+    }
+    auto deepest_done = clock_type::now();
+
+    if (queued_sum != level_sum)
+    {
+        std::cout << "(wrong order) ";
+    }
+    std::cout << "level order, depth " << deepest << ": queue: " << ns_per_op(start, queued, size)
+              << " ns/node, view: " << ns_per_op(queued, leveled, size) << " ns/node, "
+              << "deepest level alone: " << ns_per_op(leveled, deepest_done, deepest_size)
+              << " ns/node" << std::endl;
+}
+
+// a chain grown at its bottom: every insert is one level deeper,
+// so threading a node must not cost its depth;
+// without level threads the walk is O(n * depth), see get_level_order
+void bench_level_chain(size_t size)
+{
+    auto start = clock_type::now();
+    forestlib::forest<long> chain;
+    auto last = chain.end();
+    for (size_t i = 0; i < size; ++i)
+    {
+        last = chain.insert(last, static_cast<long>(i));
+    }
+    auto built = clock_type::now();
+    long sum = 0;
+    for (auto value : chain.get_level_order())
+    {
+        sum += value;
+    }
+    auto walked = clock_type::now();
+
+    if (sum != static_cast<long>(size * (size - 1) / 2))
+    {
+        std::cout << "(wrong order) ";
+    }
+    std::cout << "level order, chain of " << size << ": build: " << ns_per_op(start, built, size)
+              << " ns/node, view: " << ns_per_op(built, walked, size) << " ns/node" << std::endl;
+}
+
+// enter and exit events: a pre-order walk and a post-order one
+// against a single walk over the passes
+void bench_euler_walk(size_t size, unsigned seed)
+{
+    forestlib::forest<long> forest;
+    std::vector<forestlib::forest<long>::iterator> nodes;
+    nodes.reserve(size + 1);
+    nodes.push_back(forest.end());
+    std::mt19937 gen(seed);
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto parent = std::uniform_int_distribution<size_t>(0, i)(gen);
+        nodes.push_back(forest.insert(nodes[parent], static_cast<long>(i)));
+    }
+
+    auto start = clock_type::now();
+    long two_walks_sum = 0;
+    for (auto it = forest.begin(); it != forest.end(); ++it)
+    {
+        two_walks_sum += *it * forest.get_level(it);
+    }
+    for (auto it = forest.get_post_order().begin(); it != forest.get_post_order().end(); ++it)
+    {
+        two_walks_sum -= *it;
+    }
+    auto walked_twice = clock_type::now();
+    long one_walk_sum = 0;
+    forestlib::euler_walk(forest,
+        [&] (forestlib::forest<long>::iterator pos) { one_walk_sum += *pos * forest.get_level(pos); },
+        [&] (forestlib::forest<long>::iterator pos) { one_walk_sum -= *pos; });
+    auto walked_once = clock_type::now();
+
+    if (two_walks_sum != one_walk_sum)
+    {
+        std::cout << "(wrong events) ";
+    }
+    std::cout << "enter and exit, two walks: " << ns_per_op(start, walked_twice, size)
+              << " ns/node, euler_walk: " << ns_per_op(walked_twice, walked_once, size)
+              << " ns/node" << std::endl;
+}
+
+// tight loops of ++it and --it in both orders over a small forest
+// laid out in pre-order (built by assign_preorder): it stays in cache,
+// so the steps themselves are timed; the best of many sweeps
+void bench_sweeps(size_t size, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::vector<std::pair<unsigned, long>> preorder;
+    preorder.reserve(size);
+    unsigned level = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        level = std::uniform_int_distribution<unsigned>(1, std::min(level + 1, 16u))(gen);
+        preorder.emplace_back(level, static_cast<long>(i));
+    }
+    forestlib::forest<long> forest(preorder.begin(), preorder.end());
+
+    auto best_of = [size] (auto sweep)
+    {
+        double best = 0;
+        for (int round = 0; round < 100; ++round)
+        {
+            auto start = clock_type::now();
+            auto sum = sweep();
+            auto time = ns_per_op(start, clock_type::now(), size);
+            best = round == 0 || time < best ? time : best;
+            if (sum == 42)
+            {
+                std::cout << "(lucky) ";
+            }
+        }
+        return best;
+    };
+    auto forward = [] (auto first, auto last)
+    {
+        return [first, last]
+        {
+            long sum = 0;
+            for (auto it = first; it != last; ++it)
+            {
+                sum += *it;
+            }
+            return sum;
+        };
+    };
+    auto backward = [] (auto first, auto last)
+    {
+        return [first, last]
+        {
+            long sum = 0;
+            for (auto it = last; it != first;)
+            {
+                sum += *--it;
+            }
+            return sum;
+        };
+    };
+
+    auto post_order = forest.get_post_order();
+    std::cout << "sweeps of " << size << " nodes, pre-order ++: " << best_of(forward(forest.begin(), forest.end()))
+              << " ns/node, --: " << best_of(backward(forest.begin(), forest.end()))
+              << " ns/node, post-order ++: " << best_of(forward(post_order.begin(), post_order.end()))
+              << " ns/node, --: " << best_of(backward(post_order.begin(), post_order.end()))
+              << " ns/node" << std::endl;
+}
+
+// every step of a full walk: the average and the worst one
+// the latter is taken with the clock around each step,
+// the best of a few walks, so that a preempted step does not count
+template<typename Iter>
+void walk_steps(Iter first, Iter last, const char* name)
+{
+    size_t steps = 0;
+    auto start = clock_type::now();
+    for (auto it = first; it != last; ++it)
+    {
+        ++steps;
+    }
+    auto finish = clock_type::now();
+
+    std::vector<clock_type::duration> best(steps, clock_type::duration::max());
+    for (int walk = 0; walk < 3; ++walk)
+    {
+        auto step = best.begin();
+        auto prev = clock_type::now();
+        for (auto it = first; it != last; ++step)
+        {
+            ++it;
+            auto now = clock_type::now();
+            *step = std::min(*step, now - prev);
+            prev = now;
+        }
+    }
+    auto worst = *std::max_element(best.begin(), best.end());
+
+    std::cout << name << ": " << ns_per_op(start, finish, steps) << " ns/step, worst step: "
+              << std::chrono::duration<double, std::nano>(worst).count() << " ns" << std::endl;
+}
+
+// shapes where one step goes through many passes:
+// a chain ends with a climb of its whole depth,
+// every tooth of a comb (a root with a chain under it) does it too
+void bench_steps(size_t size)
+{
+    forestlib::forest<long> chain;
+    auto last = chain.end();
+    for (size_t i = 0; i < size; ++i)
+    {
+        last = chain.insert(last, static_cast<long>(i));
+    }
+    walk_steps(chain.begin(), chain.end(), "chain pre-order");
+    walk_steps(chain.get_post_order().begin(), chain.get_post_order().end(), "chain post-order");
+
+    forestlib::forest<long> comb;
+    auto teeth = std::max<size_t>(1, static_cast<size_t>(std::sqrt(size)));
+    for (size_t i = 0; i < teeth; ++i)
+    {
+        auto tip = comb.end();
+        for (size_t j = 0; j < size / teeth; ++j)
+        {
+            tip = comb.insert(tip, static_cast<long>(j));
+        }
+    }
+    walk_steps(comb.begin(), comb.end(), "comb pre-order");
+    walk_steps(comb.get_post_order().begin(), comb.get_post_order().end(), "comb post-order");
+}
+
+}
+
+auto main(int argc, char** argv) -> int
+{
+    size_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    unsigned seed = 42;
+
+    std::cout << "node pool: " << (FORESTLIB_NODE_POOL ? "on" : "off")
+              << ", order threads: " << (FORESTLIB_ORDER_THREADS ? "on" : "off")
+              << ", level threads: " << (FORESTLIB_LEVEL_THREADS ? "on" : "off")
+              << ", counters: " << (FORESTLIB_INSTRUMENT ? "on" : "off")
+              << ", nodes: " << size
+              << ", node<long>: " << sizeof(forestlib::detail::node_t<long>) << " bytes" << std::endl;
+    bench_insert_erase(size, seed);
+    bench_churn(size, size, seed);
+    bench_erase_roots(size, seed);
+    bench_copy(size, seed);
+    bench_clear<long>(size, seed, "long");
+    bench_clear<std::string>(size, seed, "string");
+    bench_requests(1000, 1000, seed);
+    bench_steps(size);
+    bench_frozen(size, seed);
+    bench_strings(size, seed);
+    bench_preorder(size, seed);
+    bench_save_load(size, seed);
+    bench_mapped(size, seed);
+    bench_parallel(size, seed);
+    bench_snapshot(size, seed);
+    bench_euler(size, 100000, seed);
+    bench_lca(size, 1000000, seed);
+    bench_level_order(size, seed);
+    bench_level_chain(10000);
+    bench_euler_walk(size, seed);
+    bench_sweeps(10000, seed);
+
+    if (FORESTLIB_INSTRUMENT)
+    {
+        auto counters = forestlib::global_counters();
+        std::cout << "counters: nodes allocated " << counters.nodes_allocated_
+                  << ", freed " << counters.nodes_freed_
+                  << ", bytes in use " << counters.bytes_in_use_
+                  << ", traverse steps " << counters.traverse_steps_
+                  << ", pass skips " << counters.pass_skips_
+                  << ", internal erases " << counters.internal_erases_
+                  << ", erase walk " << counters.erase_walk_
+                  << ", copies " << counters.copies_
+                  << ", copied nodes " << counters.copied_nodes_ << std::endl;
+    }
+
+    return 0;
+}
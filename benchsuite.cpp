@@ -0,0 +1,344 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <deque>
+#include <list>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+
+#include "forest.hpp"
+#include "naivetree.hpp"
+
+// usage: benchSuite [max size [min size [seed]]]
+// (1e6 and 1e3 by default, up to 1e8 if there is memory for it)
+// sizes go by powers of ten, results are printed as JSON
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+// forest shape: parent of node i (1-based) is parents[i - 1],
+// 0 is the header (or the root of a naive tree),
+// parents always come before children
+using shape_t = std::vector<size_t>;
+
+shape_t random_shape(size_t size, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    shape_t parents(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        parents[i] = std::uniform_int_distribution<size_t>(0, i)(gen);
+    }
+    return parents;
+}
+
+// one complete binary tree
+shape_t balanced_shape(size_t size, unsigned)
+{
+    shape_t parents(size);
+    for (size_t i = 1; i <= size; ++i)
+    {
+        parents[i - 1] = i / 2;
+    }
+    return parents;
+}
+
+shape_t chain_shape(size_t size, unsigned)
+{
+    shape_t parents(size);
+    for (size_t i = 1; i <= size; ++i)
+    {
+        parents[i - 1] = i - 1;
+    }
+    return parents;
+}
+
+// one root with all the rest as its children
+shape_t star_shape(size_t size, unsigned)
+{
+    shape_t parents(size, 1);
+    if (size > 0)
+    {
+        parents[0] = 0;
+    }
+    return parents;
+}
+
+// a chain with a leaf hanging off every node of it
+shape_t comb_shape(size_t size, unsigned)
+{
+    shape_t parents(size);
+    for (size_t i = 1; i <= size; ++i)
+    {
+        // odd ones are the spine
+        parents[i - 1] = i % 2 ? (i > 2 ? i - 2 : 0) : i - 1;
+    }
+    return parents;
+}
+
+struct generator_t
+{
+    const char* name;
+    shape_t (*make)(size_t, unsigned);
+};
+
+const generator_t generators[] =
+{
+    {"random", random_shape},
+    {"balanced", balanced_shape},
+    {"chain", chain_shape},
+    {"star", star_shape},
+    {"comb", comb_shape},
+};
+
+size_t max_fan_out(const shape_t& parents)
+{
+    std::vector<size_t> children(parents.size() + 1, 0);
+    for (auto parent : parents)
+    {
+        ++children[parent];
+    }
+    return *std::max_element(children.begin(), children.end());
+}
+
+struct record_t
+{
+    std::string structure;
+    std::string shape;
+    size_t size;
+    std::string op;
+    double ns_per_node;
+};
+
+class recorder_t
+{
+    public:
+        recorder_t(const char* structure, const char* shape, size_t size) :
+            structure_(structure), shape_(shape), size_(size) {}
+
+        // best of the runs: the rest is noise
+        void add(const char* op, clock_type::duration spent)
+        {
+            double ns = std::chrono::duration<double, std::nano>(spent).count() / std::max<size_t>(size_, 1);
+            for (auto& record : records_)
+            {
+                if (record.op == op && record.structure == structure_ &&
+                    record.shape == shape_ && record.size == size_)
+                {
+                    record.ns_per_node = std::min(record.ns_per_node, ns);
+                    return;
+                }
+            }
+            records_.push_back({structure_, shape_, size_, op, ns});
+        }
+
+        static const std::vector<record_t>& records() noexcept
+        {
+            return records_;
+        }
+
+    private:
+        static std::vector<record_t> records_;
+
+        const char* structure_;
+        const char* shape_;
+        size_t size_;
+};
+
+std::vector<record_t> recorder_t::records_;
+
+template<typename F>
+clock_type::duration timed(F&& f)
+{
+    auto start = clock_type::now();
+    f();
+    return clock_type::now() - start;
+}
+
+// keeps the optimizer from dropping a sweep
+volatile long sink;
+
+void run_forest(const shape_t& parents, recorder_t& rec)
+{
+    using forest_t = forestlib::forest<long>;
+
+    auto size = parents.size();
+    std::vector<forest_t::iterator> nodes;
+    nodes.reserve(size + 1);
+
+    forest_t forest;
+    nodes.push_back(forest.end());
+    rec.add("insert", timed([&]
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            nodes.push_back(forest.insert(nodes[parents[i]], static_cast<long>(i)));
+        }
+    }));
+
+    rec.add("pre_order", timed([&]
+    {
+        long sum = 0;
+        for (auto it = forest.begin(); it != forest.end(); ++it)
+        {
+            sum += *it;
+        }
+        sink = sum;
+    }));
+
+    rec.add("post_order", timed([&]
+    {
+        long sum = 0;
+        auto post = forest.get_post_order();
+        for (auto it = post.begin(); it != post.end(); ++it)
+        {
+            sum += *it;
+        }
+        sink = sum;
+    }));
+
+    forest_t copy;
+    rec.add("copy", timed([&]
+    {
+        copy = forest;
+    }));
+
+    rec.add("equal", timed([&]
+    {
+        sink = copy == forest;
+    }));
+
+    rec.add("clear", timed([&]
+    {
+        copy.clear();
+    }));
+
+    // in post-order every node is a leaf when it goes,
+    // from the front of pre-order every one is a root,
+    // internal unless it is a leaf
+    copy = forest;
+    rec.add("erase_leaves", timed([&]
+    {
+        auto post = forest.get_post_order();
+        for (auto it = post.begin(); it != post.end();)
+        {
+            it = forest.erase(it);
+        }
+    }));
+
+    rec.add("erase_internal", timed([&]
+    {
+        while (!copy.empty())
+        {
+            copy.erase(copy.begin());
+        }
+    }));
+}
+
+// naive tree has a single root, header becomes one more node;
+// it can not copy, compare, erase internal nodes
+// or walk post-order, and its leaf erasure invalidates iterators
+template<template<typename ...> typename Seq>
+void run_naive_tree(const shape_t& parents, recorder_t& rec)
+{
+    using tree_t = naive_tree::Tree<long, Seq>;
+
+    auto size = parents.size();
+    std::vector<typename tree_t::Type::TreeIteratorT> nodes;
+    nodes.reserve(size + 1);
+
+    auto tree = std::make_unique<tree_t>(-1);
+    nodes.push_back(tree->GetRoot());
+    rec.add("insert", timed([&]
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            nodes.push_back(tree->AddSucc(static_cast<long>(i), nodes[parents[i]]));
+        }
+    }));
+
+    // every step up looks for the node among its siblings,
+    // wide nodes make it quadratic
+    if (size * max_fan_out(parents) <= 10000000)
+    {
+        rec.add("pre_order", timed([&]
+        {
+            long sum = 0;
+            auto df = tree->GetDF();
+            for (auto it = df.begin(); it != df.end(); ++it)
+            {
+                sum += *it;
+            }
+            sink = sum;
+        }));
+    }
+
+    nodes.clear();
+    rec.add("clear", timed([&]
+    {
+        tree.reset();
+    }));
+}
+
+void print_json(std::ostream& out, unsigned seed)
+{
+    out << "{\n"
+        << "  \"node_pool\": " << (FORESTLIB_NODE_POOL ? "true" : "false") << ",\n"
+        << "  \"order_threads\": " << (FORESTLIB_ORDER_THREADS ? "true" : "false") << ",\n"
+        << "  \"level_threads\": " << (FORESTLIB_LEVEL_THREADS ? "true" : "false") << ",\n"
+        << "  \"seed\": " << seed << ",\n"
+        << "  \"unit\": \"ns/node\",\n"
+        << "  \"results\": [";
+    const char* separator = "\n";
+    for (const auto& record : recorder_t::records())
+    {
+        out << separator
+            << "    {\"structure\": \"" << record.structure << "\", "
+            << "\"shape\": \"" << record.shape << "\", "
+            << "\"size\": " << record.size << ", "
+            << "\"op\": \"" << record.op << "\", "
+            << "\"ns_per_node\": " << record.ns_per_node << "}";
+        separator = ",\n";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+
+}
+
+auto main(int argc, char** argv) -> int
+{
+    size_t max_size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t min_size = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+    unsigned seed = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 42;
+
+    for (size_t size = min_size; size <= max_size; size *= 10)
+    {
+        // small ones are run a few times, so that the clock has smth to measure
+        auto runs = std::max<size_t>(1, 100000 / size);
+        for (const auto& generator : generators)
+        {
+            auto parents = generator.make(size, seed);
+            recorder_t forest_rec("forest", generator.name, size);
+            recorder_t deque_rec("naive_tree<deque>", generator.name, size);
+            recorder_t list_rec("naive_tree<list>", generator.name, size);
+            for (size_t run = 0; run < runs; ++run)
+            {
+                run_forest(parents, forest_rec);
+                run_naive_tree<std::deque>(parents, deque_rec);
+                run_naive_tree<std::list>(parents, list_rec);
+            }
+        }
+        if (size > max_size / 10)
+        {
+            break;
+        }
+    }
+
+    print_json(std::cout, seed);
+    return 0;
+}
@@ -0,0 +1,809 @@
+#ifndef EULER_TREE_LIB
+#define EULER_TREE_LIB
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "forest.hpp"
+
+namespace forestlib
+{
+
+// aggregate of euler_forest: identity() and an associative operator(),
+// neither may throw
+template<typename T>
+struct sum_monoid
+{
+    T identity() const
+    {
+        return T();
+    }
+
+    T operator()(const T& lhs, const T& rhs) const
+    {
+        return lhs + rhs;
+    }
+};
+
+namespace detail
+{
+    // one pass of a node as an element of an implicit treap:
+    // the key is the position in the tour, the heap is on priority
+    struct euler_token_base_t
+    {
+        using type_t = pass_base_t::type_t;
+
+        euler_token_base_t(type_t type, std::uint32_t priority) noexcept :
+            left_(nullptr), right_(nullptr), parent_(nullptr),
+            priority_(priority), type_(type),
+            tokens_(1), leads_(type == type_t::LEAD) {}
+
+        euler_token_base_t* left_;
+        euler_token_base_t* right_;
+        euler_token_base_t* parent_;
+        std::uint32_t priority_;
+        type_t type_;
+        // tokens and lead tokens, i.e. nodes, in the treap subtree
+        std::size_t tokens_;
+        std::size_t leads_;
+    };
+
+    // tokens before token in the tour
+    std::size_t euler_position(const euler_token_base_t* token) noexcept;
+    // lead tokens before token in the tour
+    std::size_t euler_rank(const euler_token_base_t* token) noexcept;
+
+    euler_token_base_t* euler_first(euler_token_base_t* root) noexcept;
+    euler_token_base_t* euler_last(euler_token_base_t* root) noexcept;
+    euler_token_base_t* euler_next(euler_token_base_t* token) noexcept;
+    euler_token_base_t* euler_pred(euler_token_base_t* token) noexcept;
+
+    // n-th token of the traversal's type, nullptr past the last one;
+    // level is the node's
+    euler_token_base_t* euler_nth(euler_token_base_t* root, std::size_t n,
+                                  pass_base_t::type_t traversal,
+                                  node_base_t::level_t& level) noexcept;
+
+    // next token of the traversal's type, nullptr is the end in both orders;
+    // level changes as walk does, as if the tour had a header
+    euler_token_base_t* euler_walk(euler_token_base_t* root,
+                                   euler_token_base_t* token,
+                                   pass_base_t::type_t traversal,
+                                   pass_base_t::direction_t dir,
+                                   node_base_t::level_t& level) noexcept;
+
+    template<typename T>
+    struct euler_token_t : public euler_token_base_t
+    {
+        euler_token_t(type_t type, std::uint32_t priority, const T& identity) :
+            euler_token_base_t(type, priority), aggregate_(identity) {}
+
+        // of the values of the nodes led in the treap subtree, in tour order
+        T aggregate_;
+    };
+
+    template<typename T, pass_base_t::type_t Type>
+    struct euler_pass_t : public euler_token_t<T>
+    {
+        euler_pass_t(std::uint32_t priority, const T& identity) :
+            euler_token_t<T>(Type, priority, identity) {}
+    };
+
+    template<typename T>
+    struct euler_node_t : public euler_pass_t<T, pass_base_t::type_t::LEAD>,
+                          public euler_pass_t<T, pass_base_t::type_t::TAIL>
+    {
+        using lead_t = euler_pass_t<T, pass_base_t::type_t::LEAD>;
+        using tail_t = euler_pass_t<T, pass_base_t::type_t::TAIL>;
+
+        template<typename... Args>
+        euler_node_t(std::uint32_t lead_priority, std::uint32_t tail_priority,
+                     const T& identity, Args&&... args) :
+            lead_t(lead_priority, identity), tail_t(tail_priority, identity),
+            value_(std::forward<Args>(args)...) {}
+
+        euler_token_base_t* lead() noexcept
+        {
+            return static_cast<lead_t*>(this);
+        }
+
+        euler_token_base_t* tail() noexcept
+        {
+            return static_cast<tail_t*>(this);
+        }
+
+        T value_;
+    };
+
+    template<typename T>
+    euler_token_t<T>* get_euler_token(euler_token_base_t* token) noexcept
+    {
+        return static_cast<euler_token_t<T>*>(token);
+    }
+
+    template<typename T>
+    euler_node_t<T>* get_euler_node(euler_token_base_t* token) noexcept
+    {
+        if (token->type_ == pass_base_t::type_t::LEAD)
+        {
+            return static_cast<euler_node_t<T>*>(
+                static_cast<euler_pass_t<T, pass_base_t::type_t::LEAD>*>(get_euler_token<T>(token)));
+        }
+        else
+        {
+            assert(token->type_ == pass_base_t::type_t::TAIL);
+            return static_cast<euler_node_t<T>*>(
+                static_cast<euler_pass_t<T, pass_base_t::type_t::TAIL>*>(get_euler_token<T>(token)));
+        }
+    }
+}
+
+template<typename T, typename Monoid>
+class euler_forest;
+
+template<typename T>
+struct euler_iterator
+{
+    using difference_type = ptrdiff_t;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using pointer = const T*;
+    using reference = const T&;
+
+    using traversal_t = detail::pass_base_t::type_t;
+    using direction_t = detail::pass_base_t::direction_t;
+    using level_t = detail::node_base_t::level_t;
+    using token_t = detail::euler_token_base_t;
+
+    // root is where the owner keeps its treap root,
+    // a nullptr token is the end in both orders
+    euler_iterator(token_t* const* root, token_t* token, traversal_t traversal, level_t level) noexcept :
+        root_(root), token_(token), traversal_(traversal), level_(level) {}
+
+    reference operator*() const noexcept
+    {
+        return detail::get_euler_node<T>(token_)->value_;
+    }
+
+    pointer operator->() const noexcept
+    {
+        return &detail::get_euler_node<T>(token_)->value_;
+    }
+
+    euler_iterator& operator++() noexcept
+    {
+        token_ = detail::euler_walk(*root_, token_, traversal_, direction_t::NEXT, level_);
+        return *this;
+    }
+
+    euler_iterator operator++(int) noexcept
+    {
+        auto tmp = *this;
+        ++(*this);
+        return tmp;
+    }
+
+    euler_iterator& operator--() noexcept
+    {
+        token_ = detail::euler_walk(*root_, token_, traversal_, direction_t::PRED, level_);
+        return *this;
+    }
+
+    euler_iterator operator--(int) noexcept
+    {
+        auto tmp = *this;
+        --(*this);
+        return tmp;
+    }
+
+    friend bool operator==(const euler_iterator& lhs, const euler_iterator& rhs) noexcept
+    {
+        return lhs.token_ == rhs.token_ &&
+               lhs.traversal_ == rhs.traversal_;
+    }
+
+    friend bool operator!=(const euler_iterator& lhs, const euler_iterator& rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+    token_t* const* root_;
+    token_t* token_;
+    traversal_t traversal_;
+    level_t level_;
+};
+
+template<typename T>
+struct euler_post_order
+{
+    using iterator = euler_iterator<T>;
+
+    euler_post_order(detail::euler_token_base_t* const* root) noexcept :
+        root_(root) {}
+
+    iterator begin() const noexcept
+    {
+        return ++end();
+    }
+
+    iterator end() const noexcept
+    {
+        return iterator(root_, nullptr, iterator::traversal_t::TAIL, 0);
+    }
+
+    // n-th node in post-order, end() past the last one: O(log n)
+    iterator nth(size_t n) const noexcept
+    {
+        detail::node_base_t::level_t level = 0;
+        auto token = detail::euler_nth(*root_, n, iterator::traversal_t::TAIL, level);
+        return iterator(root_, token, iterator::traversal_t::TAIL, level);
+    }
+
+    private:
+        detail::euler_token_base_t* const* root_;
+};
+
+// the tour of lead and tail passes kept in a balanced tree instead of a list:
+// a subtree is the tokens from its lead to its tail, so moving it, counting it
+// and folding its values with Monoid are O(log n) expected;
+// so is finding the n-th node and the rank of one;
+// walking is amortized O(1) a step, values change only through set,
+// iterators keep the level they were made with, moves do not update it
+template<typename T, typename Monoid = sum_monoid<T>>
+class euler_forest
+{
+    public:
+        using iterator = euler_iterator<T>;
+        using const_iterator = euler_iterator<T>;
+        using level_t = detail::node_base_t::level_t;
+        using monoid_type = Monoid;
+
+        explicit euler_forest(const Monoid& monoid = Monoid()) :
+            root_(nullptr), seed_(initial_seed), version_(0), monoid_(monoid) {}
+
+        // anything with pre-order begin/end and get_level, in O(n)
+        template<typename Forest>
+        explicit euler_forest(const Forest& src, const Monoid& monoid = Monoid()) :
+            euler_forest(monoid)
+        {
+            std::vector<token_t*> tour;
+            std::vector<node_t*> path;
+            try
+            {
+                for (auto it = src.begin(); it != src.end(); ++it)
+                {
+                    close_path(path, src.get_level(it) - 1, tour);
+                    path.push_back(new_node(*it));
+                    tour.push_back(path.back()->lead());
+                }
+            }
+            catch (...)
+            {
+                for (auto token : tour)
+                {
+                    if (token->type_ == token_t::type_t::LEAD)
+                    {
+                        delete detail::get_euler_node<T>(token);
+                    }
+                }
+                throw;
+            }
+            close_path(path, 0, tour);
+            root_ = build(tour);
+        }
+
+        euler_forest(const euler_forest& rhs) :
+            euler_forest(rhs, rhs.monoid_) {}
+
+        euler_forest(euler_forest&& rhs) noexcept :
+            root_(rhs.root_), seed_(rhs.seed_), version_(rhs.version_), monoid_(rhs.monoid_)
+        {
+            rhs.root_ = nullptr;
+            ++rhs.version_;
+        }
+
+        euler_forest& operator=(euler_forest rhs) noexcept
+        {
+            swap(*this, rhs);
+            return *this;
+        }
+
+        ~euler_forest()
+        {
+            clear();
+        }
+
+        friend void swap(euler_forest& lhs, euler_forest& rhs) noexcept
+        {
+            using std::swap;
+            swap(lhs.root_, rhs.root_);
+            swap(lhs.seed_, rhs.seed_);
+            swap(lhs.monoid_, rhs.monoid_);
+            // as forest does
+            lhs.version_ = rhs.version_ = std::max(lhs.version_, rhs.version_) + 1;
+        }
+
+        iterator end() const noexcept
+        {
+            return iterator(&root_, nullptr, iterator::traversal_t::LEAD, 0);
+        }
+
+        iterator begin() const noexcept
+        {
+            return ++end();
+        }
+
+        euler_post_order<T> get_post_order() const noexcept
+        {
+            return euler_post_order<T>(&root_);
+        }
+
+        level_t get_level(const iterator pos) const noexcept
+        {
+            return pos.level_;
+        }
+
+        // from the tour, for iterators a move made stale: O(log n)
+        level_t depth(const iterator pos) const noexcept
+        {
+            auto lead = detail::get_euler_node<T>(pos.token_)->lead();
+            // leads before it opened, tails before it closed
+            auto leads = detail::euler_rank(lead);
+            return static_cast<level_t>(1 + 2 * leads - detail::euler_position(lead));
+        }
+
+        bool is_leaf(const iterator pos) const noexcept
+        {
+            return subtree_size(pos) == 1;
+        }
+
+        // n-th node in pre-order, end() past the last one: O(log n)
+        iterator nth(size_t n) const noexcept
+        {
+            level_t level = 0;
+            auto token = detail::euler_nth(root_, n, iterator::traversal_t::LEAD, level);
+            return iterator(&root_, token, iterator::traversal_t::LEAD, level);
+        }
+
+        // index of pos in its own order, size() for the end: O(log n)
+        size_t rank(const iterator pos) const noexcept
+        {
+            if (!pos.token_)
+            {
+                return size();
+            }
+            auto leads = detail::euler_rank(pos.token_);
+            if (pos.traversal_ == iterator::traversal_t::LEAD)
+            {
+                return leads;
+            }
+            // tails before it
+            return detail::euler_position(pos.token_) - leads;
+        }
+
+        // both in the same order: O(log n)
+        typename iterator::difference_type distance(const iterator first, const iterator last) const noexcept
+        {
+            return static_cast<typename iterator::difference_type>(rank(last)) -
+                   static_cast<typename iterator::difference_type>(rank(first));
+        }
+
+        size_t size() const noexcept
+        {
+            return root_ ? root_->leads_ : 0;
+        }
+
+        bool empty() const noexcept
+        {
+            return root_ == nullptr;
+        }
+
+        // changes with every change of the shape, not with set
+        std::uint64_t version() const noexcept
+        {
+            return version_;
+        }
+
+        void clear() noexcept
+        {
+            // left children are rotated up, so tokens come in tour order
+            // without going back up; a node goes at its tail,
+            // its lead was passed already
+            auto token = root_;
+            while (token)
+            {
+                if (auto left = token->left_)
+                {
+                    token->left_ = left->right_;
+                    left->right_ = token;
+                    token = left;
+                    continue;
+                }
+                auto next = token->right_;
+                if (token->type_ == token_t::type_t::TAIL)
+                {
+                    delete detail::get_euler_node<T>(token);
+                }
+                token = next;
+            }
+            root_ = nullptr;
+            ++version_;
+        }
+
+        // new node becomes the last child of pos, end() makes it the last root
+        iterator insert(iterator pos, const T& value)
+        {
+            return emplace(pos, value);
+        }
+
+        iterator insert(iterator pos, T&& value)
+        {
+            return emplace(pos, std::move(value));
+        }
+
+        template<typename... Args>
+        iterator emplace(iterator pos, Args&&... args)
+        {
+            auto node = new_node(std::forward<Args>(args)...);
+            auto at = pos.token_ ? detail::euler_position(tail(pos)) : size_of(root_);
+            token_t* first;
+            token_t* rest;
+            split(root_, at, first, rest);
+            root_ = merge(merge(first, merge(node->lead(), node->tail())), rest);
+            ++version_;
+            return iterator(&root_, node->lead(), iterator::traversal_t::LEAD,
+                            pos.token_ ? get_level(pos) + 1 : 1);
+        }
+
+        // children of pos take its place, returns the next one in pre-order
+        iterator erase(iterator pos) noexcept
+        {
+            auto next = pos;
+            ++next;
+            if (pos.traversal_ == iterator::traversal_t::LEAD && !is_leaf(pos))
+            {
+                --next.level_;
+            }
+
+            auto node = detail::get_euler_node<T>(pos.token_);
+            auto lead_at = detail::euler_position(node->lead());
+            auto tail_at = detail::euler_position(node->tail());
+            token_t* first;
+            token_t* lead;
+            token_t* children;
+            token_t* tail;
+            token_t* rest;
+            split(root_, lead_at, first, rest);
+            split(rest, 1, lead, rest);
+            split(rest, tail_at - lead_at - 1, children, rest);
+            split(rest, 1, tail, rest);
+            root_ = merge(merge(first, children), rest);
+            delete node;
+            ++version_;
+            return next;
+        }
+
+        void set(iterator pos, const T& value)
+        {
+            auto node = detail::get_euler_node<T>(pos.token_);
+            node->value_ = value;
+            // the lead is the one token that carries the value
+            for (auto token = node->lead(); token; token = token->parent_)
+            {
+                update(token);
+            }
+        }
+
+        // pos with its subtree becomes the last child of parent,
+        // end() makes it the last root; the new iterator has the new level;
+        // throws std::invalid_argument if parent is in the subtree
+        iterator move_subtree(iterator pos, iterator parent)
+        {
+            auto lead_at = detail::euler_position(lead(pos));
+            auto tail_at = detail::euler_position(tail(pos));
+            if (parent.token_)
+            {
+                auto parent_at = detail::euler_position(lead(parent));
+                if (parent_at >= lead_at && parent_at <= tail_at)
+                {
+                    throw std::invalid_argument("euler_forest: parent is in the moved subtree");
+                }
+            }
+
+            token_t* first;
+            token_t* subtree;
+            token_t* rest;
+            split(root_, lead_at, first, rest);
+            split(rest, tail_at - lead_at + 1, subtree, rest);
+            root_ = merge(first, rest);
+
+            auto at = parent.token_ ? detail::euler_position(tail(parent)) : size_of(root_);
+            split(root_, at, first, rest);
+            root_ = merge(merge(first, subtree), rest);
+            ++version_;
+            return iterator(&root_, lead(pos), iterator::traversal_t::LEAD,
+                            parent.token_ ? depth(parent) + 1 : 1);
+        }
+
+        // root pos becomes the last child of parent;
+        // throws std::invalid_argument if pos is not a root or parent is in its subtree
+        iterator link(iterator pos, iterator parent)
+        {
+            if (depth(pos) != 1)
+            {
+                throw std::invalid_argument("euler_forest: linked node is not a root");
+            }
+            return move_subtree(pos, parent);
+        }
+
+        // pos with its subtree becomes the last root
+        iterator cut(iterator pos)
+        {
+            return move_subtree(pos, end());
+        }
+
+        // number of nodes in pos's subtree, pos included: O(log n)
+        size_t subtree_size(const iterator pos) const noexcept
+        {
+            return (detail::euler_position(tail(pos)) - detail::euler_position(lead(pos)) + 1) / 2;
+        }
+
+        // Monoid over the values of pos's subtree in pre-order: O(log n)
+        T aggregate(const iterator pos) const
+        {
+            return query(root_, detail::euler_position(lead(pos)),
+                         detail::euler_position(tail(pos)) + 1);
+        }
+
+        // over the whole forest
+        T aggregate() const
+        {
+            return root_ ? token(root_)->aggregate_ : monoid_.identity();
+        }
+
+        friend bool operator==(const euler_forest& lhs, const euler_forest& rhs)
+        {
+            if (lhs.size() != rhs.size())
+            {
+                return false;
+            }
+            for (auto left = lhs.begin(), right = rhs.begin(); left != lhs.end(); ++left, ++right)
+            {
+                if (left.level_ != right.level_ || !(*left == *right))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        friend bool operator!=(const euler_forest& lhs, const euler_forest& rhs)
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        using token_t = detail::euler_token_base_t;
+        using node_t = detail::euler_node_t<T>;
+
+        static constexpr std::uint32_t initial_seed = 2463534242u;
+
+        static size_t size_of(const token_t* token) noexcept
+        {
+            return token ? token->tokens_ : 0;
+        }
+
+        static detail::euler_token_t<T>* token(token_t* token) noexcept
+        {
+            return detail::get_euler_token<T>(token);
+        }
+
+        static token_t* lead(const iterator pos) noexcept
+        {
+            return detail::get_euler_node<T>(pos.token_)->lead();
+        }
+
+        static token_t* tail(const iterator pos) noexcept
+        {
+            return detail::get_euler_node<T>(pos.token_)->tail();
+        }
+
+        // xorshift, treap shape only has to look random
+        std::uint32_t priority() noexcept
+        {
+            seed_ ^= seed_ << 13;
+            seed_ ^= seed_ >> 17;
+            seed_ ^= seed_ << 5;
+            return seed_;
+        }
+
+        template<typename... Args>
+        node_t* new_node(Args&&... args)
+        {
+            auto lead_priority = priority();
+            auto tail_priority = priority();
+            auto node = new node_t(lead_priority, tail_priority, monoid_.identity(),
+                                   std::forward<Args>(args)...);
+            // the lead's own aggregate is its value
+            update(node->lead());
+            return node;
+        }
+
+        // tails of the nodes deeper than level
+        static void close_path(std::vector<node_t*>& path, size_t level, std::vector<token_t*>& tour)
+        {
+            for (; path.size() > level; path.pop_back())
+            {
+                tour.push_back(path.back()->tail());
+            }
+        }
+
+        void update(token_t* node) noexcept
+        {
+            node->tokens_ = 1;
+            node->leads_ = node->type_ == token_t::type_t::LEAD;
+            T aggregate = node->leads_ ? detail::get_euler_node<T>(node)->value_ : monoid_.identity();
+            if (node->left_)
+            {
+                node->tokens_ += node->left_->tokens_;
+                node->leads_ += node->left_->leads_;
+                aggregate = monoid_(token(node->left_)->aggregate_, aggregate);
+            }
+            if (node->right_)
+            {
+                node->tokens_ += node->right_->tokens_;
+                node->leads_ += node->right_->leads_;
+                aggregate = monoid_(aggregate, token(node->right_)->aggregate_);
+            }
+            token(node)->aggregate_ = std::move(aggregate);
+        }
+
+        // first count tokens go to left, the others to right
+        void split(token_t* node, size_t count, token_t*& left, token_t*& right) noexcept
+        {
+            split_tree(node, count, left, right);
+            if (left)
+            {
+                left->parent_ = nullptr;
+            }
+            if (right)
+            {
+                right->parent_ = nullptr;
+            }
+        }
+
+        void split_tree(token_t* node, size_t count, token_t*& left, token_t*& right) noexcept
+        {
+            if (!node)
+            {
+                left = right = nullptr;
+                return;
+            }
+            if (size_of(node->left_) < count)
+            {
+                split_tree(node->right_, count - size_of(node->left_) - 1, node->right_, right);
+                if (node->right_)
+                {
+                    node->right_->parent_ = node;
+                }
+                left = node;
+            }
+            else
+            {
+                split_tree(node->left_, count, left, node->left_);
+                if (node->left_)
+                {
+                    node->left_->parent_ = node;
+                }
+                right = node;
+            }
+            update(node);
+        }
+
+        token_t* merge(token_t* left, token_t* right) noexcept
+        {
+            if (!left || !right)
+            {
+                return left ? left : right;
+            }
+            if (left->priority_ > right->priority_)
+            {
+                left->right_ = merge(left->right_, right);
+                left->right_->parent_ = left;
+                update(left);
+                return left;
+            }
+            right->left_ = merge(left, right->left_);
+            right->left_->parent_ = right;
+            update(right);
+            return right;
+        }
+
+        // treap of tokens in tour order, O(n): the right spine is kept on a stack
+        token_t* build(const std::vector<token_t*>& tour) noexcept
+        {
+            std::vector<token_t*> spine;
+            for (auto node : tour)
+            {
+                token_t* last = nullptr;
+                for (; !spine.empty() && spine.back()->priority_ < node->priority_; spine.pop_back())
+                {
+                    last = spine.back();
+                }
+                node->left_ = last;
+                if (last)
+                {
+                    last->parent_ = node;
+                }
+                if (!spine.empty())
+                {
+                    spine.back()->right_ = node;
+                    node->parent_ = spine.back();
+                }
+                spine.push_back(node);
+            }
+            if (spine.empty())
+            {
+                return nullptr;
+            }
+            update_all(spine.front());
+            return spine.front();
+        }
+
+        void update_all(token_t* node) noexcept
+        {
+            if (node->left_)
+            {
+                update_all(node->left_);
+            }
+            if (node->right_)
+            {
+                update_all(node->right_);
+            }
+            update(node);
+        }
+
+        // Monoid over tokens [first, last) of node's treap subtree
+        T query(token_t* node, size_t first, size_t last) const
+        {
+            if (!node || first >= last)
+            {
+                return monoid_.identity();
+            }
+            if (first == 0 && last == node->tokens_)
+            {
+                return token(node)->aggregate_;
+            }
+
+            auto left = size_of(node->left_);
+            T aggregate = monoid_.identity();
+            if (first < left)
+            {
+                aggregate = query(node->left_, first, std::min(last, left));
+            }
+            if (first <= left && left < last && node->type_ == token_t::type_t::LEAD)
+            {
+                aggregate = monoid_(aggregate, detail::get_euler_node<T>(node)->value_);
+            }
+            if (last > left + 1)
+            {
+                aggregate = monoid_(aggregate, query(node->right_, first > left ? first - left - 1 : 0,
+                                                     last - left - 1));
+            }
+            return aggregate;
+        }
+
+        token_t* root_;
+        std::uint32_t seed_;
+        std::uint64_t version_;
+        Monoid monoid_;
+};
+
+} //forest
+#endif //EULER_TREE_LIB
@@ -1,64 +1,1317 @@
 #include "forest.hpp"
+#include "eulerforest.hpp"
+#include "indexforest.hpp"
+#include "lcaindex.hpp"
+#include "parallelforest.hpp"
+#include "snapshotforest.hpp"
 
 #include <cassert>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace forestlib;
 using namespace detail;
 
-pass_base_t::type_t detail::opposite_pass_type(pass_base_t::type_t type) noexcept
+#if FORESTLIB_INSTRUMENT
+std::atomic<std::uint64_t> detail::global_counts[COUNTERS];
+
+forest_counters detail::make_counters(const std::uint64_t* counts) noexcept
 {
-    switch (type)
+    forest_counters counters;
+    counters.nodes_allocated_ = counts[NODES_ALLOCATED];
+    counters.nodes_freed_ = counts[NODES_FREED];
+    counters.bytes_in_use_ = counts[BYTES_IN_USE];
+    counters.traverse_steps_ = counts[TRAVERSE_STEPS];
+    counters.pass_skips_ = counts[PASS_SKIPS];
+    counters.internal_erases_ = counts[INTERNAL_ERASES];
+    counters.erase_walk_ = counts[ERASE_WALK];
+    counters.copies_ = counts[COPIES];
+    counters.copied_nodes_ = counts[COPIED_NODES];
+    return counters;
+}
+#endif
+
+forest_counters forestlib::global_counters() noexcept
+{
+#if FORESTLIB_INSTRUMENT
+    std::uint64_t counts[COUNTERS];
+    for (std::size_t counter = 0; counter < COUNTERS; ++counter)
     {
-        case pass_base_t::type_t::LEAD:
-            return pass_base_t::type_t::TAIL;
+        counts[counter] = global_counts[counter].load(std::memory_order_relaxed);
+    }
+    return make_counters(counts);
+#else
+    return forest_counters();
+#endif
+}
 
-        case pass_base_t::type_t::TAIL:
-            return pass_base_t::type_t::LEAD;
+// bytes in use are not counted from the start, they stay
+void forestlib::reset_global_counters() noexcept
+{
+#if FORESTLIB_INSTRUMENT
+    for (std::size_t counter = 0; counter < COUNTERS; ++counter)
+    {
+        if (counter != BYTES_IN_USE)
+        {
+            global_counts[counter].store(0, std::memory_order_relaxed);
+        }
+    }
+#endif
+}
 
-        default:
-            assert(0 && "wrong argument");
+node_base_t* detail::skip_subtree(node_base_t* node, node_base_t::level_t& level) noexcept
+{
+    // node's own tail pass is the first level up
+    node_base_t::level_t passed = 1;
+    auto cur_pass = node->get_tail_pass().next_;
+    for (;cur_pass.type() == pass_base_t::type_t::TAIL;
+         cur_pass = cur_pass->next_)
+    {
+        ++passed;
     }
+
+    level = level + 1 - passed;
+    return get_node(cur_pass);
 }
 
-node_base_t* detail::traverse(node_base_t* node,
-                              pass_base_t::type_t traversal,
-                              pass_base_t::direction_t dir) noexcept
+const node_base_t* detail::skip_subtree(const node_base_t* node, node_base_t::level_t& level) noexcept
 {
-    auto considered_type = traversal;
-    auto opposite_type = opposite_pass_type(considered_type);
+    return skip_subtree(const_cast<node_base_t*>(node), level);
+}
 
-    // passing edges leading to opposite pass
-    auto cur_pass = node->get_pass(considered_type).get(dir);
-    for (;cur_pass->type_ == opposite_type;
-         cur_pass = cur_pass->get(dir));
+void detail::write_varint(std::ostream& out, std::uint64_t value)
+{
+    char bytes[10];
+    std::size_t size = 0;
+    for (; value >= 0x80; value >>= 7)
+    {
+        bytes[size++] = static_cast<char>(value | 0x80);
+    }
+    bytes[size++] = static_cast<char>(value);
+    out.write(bytes, size);
+}
 
-    assert(cur_pass->type_ == considered_type);
-    return get_node(cur_pass);
+std::uint64_t detail::read_varint(std::istream& in)
+{
+    std::uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        auto byte = in.get();
+        if (byte == std::istream::traits_type::eof())
+        {
+            break;
+        }
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+    throw std::runtime_error("forest: corrupt stream");
+}
+
+namespace
+{
+
+constexpr char stream_magic[4] = {'F', 'R', 'S', 'T'};
+constexpr unsigned char stream_version = 1;
+
+// flags
+constexpr unsigned char raw_values = 1;
+constexpr unsigned char little_endian = 2;
+
+unsigned char byte_order() noexcept
+{
+    const std::uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first ? little_endian : 0;
+}
+
+}
+
+// magic, version, flags, then varints:
+// value size, number of nodes, chunk size
+void detail::write_header(std::ostream& out, const stream_header_t& header)
+{
+    out.write(stream_magic, sizeof(stream_magic));
+    out.put(static_cast<char>(stream_version));
+    out.put(static_cast<char>((header.raw_ ? raw_values : 0) | byte_order()));
+    write_varint(out, header.value_size_);
+    write_varint(out, header.size_);
+    write_varint(out, header.chunk_size_);
+}
+
+detail::stream_header_t detail::read_header(std::istream& in)
+{
+    char magic[sizeof(stream_magic)];
+    in.read(magic, sizeof(magic));
+    if (!in || std::memcmp(magic, stream_magic, sizeof(magic)) != 0)
+    {
+        throw std::runtime_error("forest: not a forest stream");
+    }
+    auto version = in.get();
+    auto flags = in.get();
+    if (!in || version != stream_version)
+    {
+        throw std::runtime_error("forest: unsupported stream version");
+    }
+    if ((flags & little_endian) != byte_order())
+    {
+        throw std::runtime_error("forest: stream of another byte order");
+    }
+
+    stream_header_t header;
+    header.raw_ = flags & raw_values;
+    header.value_size_ = read_varint(in);
+    header.size_ = read_varint(in);
+    header.chunk_size_ = read_varint(in);
+    return header;
+}
+
+namespace
+{
+
+// runs f(block) for every block, the first one on the calling thread
+template<typename F>
+void run_blocks(std::size_t blocks, F f)
+{
+    std::vector<std::thread> workers;
+    workers.reserve(blocks);
+    try
+    {
+        for (std::size_t block = 1; block < blocks; ++block)
+        {
+            workers.emplace_back(f, block);
+        }
+    }
+    catch (...)
+    {
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        throw;
+    }
+    f(0);
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+}
+
+// parent of a node is the nearest node before it that is one level up
+// every block finds parents with a stack of its own, the stack
+// left is the block's part of the path to its last node;
+// the ones left without a parent (no node one level up in the block)
+// look for it in these parts of the blocks before
+std::vector<std::size_t> detail::preorder_parents(const node_base_t::level_t* levels,
+                                                  std::size_t size, unsigned threads)
+{
+    constexpr std::size_t min_block_size = 1 << 16;
+    constexpr auto unknown = static_cast<std::size_t>(-1);
+
+    // path part at levels [level_, level_ + path_.size())
+    struct block_t
+    {
+        std::size_t first_;
+        std::size_t last_;
+        bool valid_;
+        node_base_t::level_t level_;
+        std::vector<std::size_t> path_;
+        // (block, level) where path parts of the blocks before start,
+        // the ones that reach this block
+        std::vector<std::pair<std::size_t, node_base_t::level_t>> above_;
+    };
+
+    std::size_t count = std::max<std::size_t>(1, std::min<std::size_t>(threads, size / min_block_size));
+    std::vector<block_t> blocks(count);
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        blocks[b].first_ = size * b / count;
+        blocks[b].last_ = size * (b + 1) / count;
+    }
+
+    std::vector<std::size_t> parents(size);
+    run_blocks(count, [&] (std::size_t b)
+    {
+        auto& block = blocks[b];
+        auto& path = block.path_;
+        block.valid_ = true;
+        for (auto i = block.first_; i < block.last_; ++i)
+        {
+            auto level = levels[i];
+            if (level == 0 || level > (i > 0 ? levels[i - 1] : 0) + 1)
+            {
+                block.valid_ = false;
+                return;
+            }
+            while (!path.empty() && levels[path.back()] >= level)
+            {
+                path.pop_back();
+            }
+            // path goes one level at a time, so its top is one level up
+            parents[i] = level == 1 ? size : (path.empty() ? unknown : path.back());
+            path.push_back(i);
+        }
+        block.level_ = path.empty() ? 1 : levels[path.front()];
+    });
+
+    for (const auto& block : blocks)
+    {
+        if (!block.valid_)
+        {
+            throw std::invalid_argument("forest: levels are not a pre-order");
+        }
+    }
+
+    // path to the end of every block, as parts of the blocks
+    std::vector<std::pair<std::size_t, node_base_t::level_t>> parts;
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        auto& block = blocks[b];
+        block.above_ = parts;
+        if (block.first_ == block.last_)
+        {
+            continue;
+        }
+        while (!parts.empty() && parts.back().second >= block.level_)
+        {
+            parts.pop_back();
+        }
+        parts.emplace_back(b, block.level_);
+    }
+
+    run_blocks(count, [&] (std::size_t b)
+    {
+        auto& block = blocks[b];
+        for (auto i = block.first_; i < block.last_; ++i)
+        {
+            if (parents[i] != unknown)
+            {
+                continue;
+            }
+            auto level = levels[i] - 1;
+            // the last part starting at level or above it
+            auto part = std::upper_bound(block.above_.begin(), block.above_.end(), level,
+                                         [] (node_base_t::level_t level, const auto& part)
+                                         {
+                                             return level < part.second;
+                                         });
+            assert(part != block.above_.begin() && "no parent for a valid pre-order");
+            --part;
+            parents[i] = blocks[part->first].path_[level - part->second];
+        }
+    });
+
+    return parents;
+}
+
+#if FORESTLIB_ORDER_THREADS
+void detail::thread_leaf(node_base_t* leaf) noexcept
+{
+    constexpr auto pre = pass_base_t::type_t::LEAD;
+    constexpr auto post = pass_base_t::type_t::TAIL;
+
+    // pre-order: right after the last node of parent's subtree,
+    // levels are counted from parent's one
+    node_base_t::level_t level = 1;
+    auto pred = walk(leaf, pre, pass_base_t::direction_t::PRED, level);
+    auto pred_level = static_cast<node_base_t::level_shift_t>(level);
+    auto next = pred->order_next_[pre];
+
+    leaf->order_pred_[pre] = pred;
+    leaf->order_next_[pre] = next;
+    leaf->order_shift_[pre] = pred->order_shift_[pre] + pred_level - 1;
+    pred->order_next_[pre] = leaf;
+    pred->order_shift_[pre] = 1 - pred_level;
+    next->order_pred_[pre] = leaf;
+
+    // post-order: right before the first node after leaf,
+    // which is parent for the last child
+    level = 1;
+    auto post_next = walk(leaf, post, pass_base_t::direction_t::NEXT, level);
+    auto next_level = static_cast<node_base_t::level_shift_t>(level);
+    auto post_pred = post_next->order_pred_[post];
+
+    leaf->order_pred_[post] = post_pred;
+    leaf->order_next_[post] = post_next;
+    leaf->order_shift_[post] = next_level - 1;
+    post_pred->order_next_[post] = leaf;
+    post_pred->order_shift_[post] += 1 - next_level;
+    post_next->order_pred_[post] = leaf;
+}
+
+void detail::unthread_leaf(node_base_t* leaf) noexcept
+{
+    for (auto order : {pass_base_t::type_t::LEAD, pass_base_t::type_t::TAIL})
+    {
+        auto pred = leaf->order_pred_[order];
+        auto next = leaf->order_next_[order];
+        pred->order_next_[order] = next;
+        pred->order_shift_[order] += leaf->order_shift_[order];
+        next->order_pred_[order] = pred;
+    }
+}
+
+// node's subtree goes a level up, inside it shifts stay the same,
+// only the ones at its borders change
+void detail::unthread_internal(node_base_t* node) noexcept
+{
+    constexpr auto pre = pass_base_t::type_t::LEAD;
+    constexpr auto post = pass_base_t::type_t::TAIL;
+
+    // pre-order: the first child is where node was,
+    // the way out of the subtree is a level shorter
+    auto pass = node->get_tail_pass().pred_;
+    for (;pass.type() == pass_base_t::type_t::TAIL;
+         pass = pass->pred_);
+    ++get_node(pass)->order_shift_[pre];
+
+    auto pred = node->order_pred_[pre];
+    auto next = node->order_next_[pre];
+    pred->order_next_[pre] = next;
+    next->order_pred_[pre] = pred;
+
+    // post-order: the way into the subtree is a level shorter,
+    // the last child leads where node did
+    pass = node->get_lead_pass().pred_;
+    for (;pass.type() == pass_base_t::type_t::LEAD;
+         pass = pass->pred_);
+    --get_node(pass)->order_shift_[post];
+
+    pred = node->order_pred_[post];
+    next = node->order_next_[post];
+    pred->order_next_[post] = next;
+    pred->order_shift_[post] = node->order_shift_[post];
+    next->order_pred_[post] = pred;
+}
+#endif
+
+#if FORESTLIB_LEVEL_THREADS
+void detail::thread_level(node_base_t* leaf, level_thread_t& level) noexcept
+{
+    // nodes between siblings on their level are all in the subtree
+    // of the previous one, so a sibling is a neighbour
+    auto pred = prev_sibling(leaf);
+    auto next = pred ? nullptr : next_sibling(leaf);
+    if (!pred && !next)
+    {
+        // cousins are children of the nodes on parent's level,
+        // none of the nearer ones have any
+        auto back = leaf->parent_->level_pred_;
+        auto forth = leaf->parent_->level_next_;
+        for (;; back = back->level_pred_, forth = forth->level_next_)
+        {
+            if (!back)
+            {
+                next = level.head_;
+                break;
+            }
+            if (!forth)
+            {
+                pred = level.tail_;
+                break;
+            }
+            if ((pred = last_child(back)) || (next = first_child(forth)))
+            {
+                break;
+            }
+        }
+    }
+    if (pred)
+    {
+        next = pred->level_next_;
+    }
+    else if (next)
+    {
+        pred = next->level_pred_;
+    }
+
+    leaf->level_pred_ = pred;
+    leaf->level_next_ = next;
+    (pred ? pred->level_next_ : level.head_) = leaf;
+    (next ? next->level_pred_ : level.tail_) = leaf;
+}
+
+void detail::unthread_level_leaf(node_base_t* leaf, level_thread_t& level) noexcept
+{
+    auto pred = leaf->level_pred_;
+    auto next = leaf->level_next_;
+    (pred ? pred->level_next_ : level.head_) = next;
+    (next ? next->level_pred_ : level.tail_) = pred;
+}
+
+// on every level from node's one down a run of node's subtree
+// is replaced by the run of their children from the level below
+std::size_t detail::unthread_level_internal(node_base_t* node, level_thread_t* levels) noexcept
+{
+    std::size_t looked_through = 0;
+    auto first = node;
+    auto last = node;
+    auto pred = node->level_pred_;
+    auto next = node->level_next_;
+    for (;; ++levels)
+    {
+        node_base_t* first_below = nullptr;
+        node_base_t* last_below = nullptr;
+        for (auto run = first; ++looked_through, !(first_below = first_child(run)) && run != last;
+             run = run->level_next_);
+        if (!first_below)
+        {
+            (pred ? pred->level_next_ : levels->head_) = next;
+            (next ? next->level_pred_ : levels->tail_) = pred;
+            return looked_through;
+        }
+        for (auto run = last; ++looked_through, !(last_below = last_child(run)); run = run->level_pred_);
+
+        auto pred_below = first_below->level_pred_;
+        auto next_below = last_below->level_next_;
+        first_below->level_pred_ = pred;
+        last_below->level_next_ = next;
+        (pred ? pred->level_next_ : levels->head_) = first_below;
+        (next ? next->level_pred_ : levels->tail_) = last_below;
+
+        first = first_below;
+        last = last_below;
+        pred = pred_below;
+        next = next_below;
+    }
+}
+#else
+namespace
+{
+    // from node on level `at`, the first node on level in pre-order:
+    // down through first children, past subtrees that do not reach it
+    node_base_t* down_to_level(node_base_t* node, node_base_t::level_t at,
+                               node_base_t::level_t level) noexcept
+    {
+        while (at != 0 && at != level)
+        {
+            if (auto child = detail::first_child(node))
+            {
+                node = child;
+                ++at;
+            }
+            else
+            {
+                node = detail::skip_subtree(node, at);
+            }
+        }
+        return at == 0 ? nullptr : node;
+    }
+}
+#endif
+
+node_base_t* detail::first_on_level(node_base_t* header, node_base_t::level_t level) noexcept
+{
+#if FORESTLIB_LEVEL_THREADS
+    auto& levels = static_cast<header_t*>(header)->levels_;
+    return level != 0 && level <= levels.size() ? levels[level - 1].head_ : nullptr;
+#else
+    auto root = first_child(header);
+    return level != 0 && root ? down_to_level(root, 1, level) : nullptr;
+#endif
+}
+
+const node_base_t* detail::first_on_level(const node_base_t* header, node_base_t::level_t level) noexcept
+{
+    return first_on_level(const_cast<node_base_t*>(header), level);
+}
+
+node_base_t* detail::next_on_level(node_base_t* node, node_base_t::level_t level) noexcept
+{
+#if FORESTLIB_LEVEL_THREADS
+    (void)level;
+    return node->level_next_;
+#else
+    auto at = level;
+    node = skip_subtree(node, at);
+    return down_to_level(node, at, level);
+#endif
+}
+
+const node_base_t* detail::next_on_level(const node_base_t* node, node_base_t::level_t level) noexcept
+{
+    return next_on_level(const_cast<node_base_t*>(node), level);
+}
+
+std::uint32_t detail::index_walk(const index_node_t* nodes, std::uint32_t node,
+                                 pass_base_t::type_t traversal,
+                                 pass_base_t::direction_t dir,
+                                 node_base_t::level_t& level) noexcept
+{
+    auto next = [nodes, dir] (index_link_t pass)
+    {
+        auto& pass_node = nodes[pass >> 1];
+        return dir == pass_base_t::direction_t::NEXT ? pass_node.next_[pass & 1] : pass_node.pred_[pass & 1];
+    };
+
+    // passing edges leading to opposite pass,
+    // as walk does
+    node_base_t::level_t passed = 0;
+    auto cur_pass = next(index_link(node, traversal));
+    for (;(cur_pass & 1) != static_cast<index_link_t>(traversal);
+         cur_pass = next(cur_pass))
+    {
+        ++passed;
+    }
+
+    if ((traversal == pass_base_t::type_t::LEAD) == (dir == pass_base_t::direction_t::NEXT))
+    {
+        level = level + 1 - passed;
+    }
+    else
+    {
+        level = level - 1 + passed;
+    }
+    return cur_pass >> 1;
+}
+
+namespace
+{
+
+constexpr char index_image_magic[8] = {'F', 'R', 'S', 'T', 'I', 'D', 'X', '\0'};
+constexpr std::uint32_t index_image_version = 1;
+constexpr std::uint32_t index_image_probe = 0x01020304;
+
+}
+
+detail::index_image_header_t detail::make_index_image_header(std::size_t size, std::size_t value_size,
+                                                             std::size_t value_align) noexcept
+{
+    index_image_header_t header{};
+    std::memcpy(header.magic_, index_image_magic, sizeof(index_image_magic));
+    header.version_ = index_image_version;
+    header.probe_ = index_image_probe;
+    header.value_size_ = static_cast<std::uint32_t>(value_size);
+    header.value_align_ = static_cast<std::uint32_t>(value_align);
+    header.size_ = size;
+    // header and nodes, rounded up for the values
+    auto offset = sizeof(header) + (size + 1) * sizeof(index_node_t);
+    header.values_offset_ = (offset + value_align - 1) / value_align * value_align;
+    return header;
+}
+
+const detail::index_image_header_t& detail::check_index_image(const char* data, std::size_t length,
+                                                              std::size_t value_size, std::size_t value_align)
+{
+    if (length < sizeof(index_image_header_t) ||
+        std::memcmp(data, index_image_magic, sizeof(index_image_magic)) != 0)
+    {
+        throw std::runtime_error("forest: not an index forest image");
+    }
+
+    // mappings are page aligned
+    auto& header = *reinterpret_cast<const index_image_header_t*>(data);
+    if (header.version_ != index_image_version)
+    {
+        throw std::runtime_error("forest: unsupported image version");
+    }
+    if (header.probe_ != index_image_probe)
+    {
+        throw std::runtime_error("forest: image of another byte order");
+    }
+    if (header.value_size_ != value_size || header.value_align_ != value_align)
+    {
+        throw std::runtime_error("forest: image holds values of another type");
+    }
+    // nodes come before the values and both within length,
+    // size_ is checked first so nothing below overflows
+    if (header.size_ > max_index_size ||
+        header.values_offset_ != make_index_image_header(header.size_, value_size, value_align).values_offset_ ||
+        sizeof(header) + (header.size_ + 1) * sizeof(index_node_t) > header.values_offset_ ||
+        header.values_offset_ > length ||
+        length - header.values_offset_ < header.size_ * value_size)
+    {
+        throw std::runtime_error("forest: corrupt image");
+    }
+    return header;
+}
+
+detail::mapped_file::mapped_file(const char* path) :
+    data_(nullptr), size_(0)
+{
+    auto fail = [path]
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                std::string("forest: can not map ") + path);
+    };
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fail();
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+        auto error = errno;
+        ::close(fd);
+        errno = error;
+        fail();
+    }
+
+    size_ = static_cast<std::size_t>(info.st_size);
+    // nothing to map, data() is nullptr
+    if (size_ > 0)
+    {
+        auto data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            auto error = errno;
+            ::close(fd);
+            errno = error;
+            fail();
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    // the mapping outlives the descriptor
+    ::close(fd);
+}
+
+detail::mapped_file::mapped_file(mapped_file&& rhs) noexcept :
+    data_(rhs.data_), size_(rhs.size_)
+{
+    rhs.data_ = nullptr;
+    rhs.size_ = 0;
+}
+
+detail::mapped_file& detail::mapped_file::operator=(mapped_file&& rhs) noexcept
+{
+    std::swap(data_, rhs.data_);
+    std::swap(size_, rhs.size_);
+    return *this;
+}
+
+detail::mapped_file::~mapped_file()
+{
+    if (data_)
+    {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+namespace
+{
+
+// the pool and the worker the thread works for
+thread_local const parallel::thread_pool* current_pool = nullptr;
+thread_local unsigned current_worker = 0;
+
+}
+
+parallel::thread_pool::thread_pool(unsigned threads) :
+    pending_(0), queued_(0), idle_(0), generation_(0), stop_(false), failed_(false)
+{
+    threads = std::max(threads, 1u);
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        workers_.push_back(std::make_unique<worker_t>());
+    }
+    // 0 is for the thread calling run
+    threads_.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        threads_.emplace_back(&thread_pool::work, this, i);
+    }
+}
+
+parallel::thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void parallel::thread_pool::run(task_t task)
+{
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    failed_.store(false);
+    error_ = nullptr;
+    pending_.store(1);
+    {
+        std::lock_guard<std::mutex> lock(workers_[0]->mutex_);
+        workers_[0]->tasks_.push_back(std::move(task));
+    }
+    queued_.store(1);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    auto outer_pool = current_pool;
+    auto outer_worker = current_worker;
+    current_pool = this;
+    current_worker = 0;
+    help(0);
+    current_pool = outer_pool;
+    current_worker = outer_worker;
+
+    if (error_)
+    {
+        std::rethrow_exception(error_);
+    }
+}
+
+void parallel::thread_pool::spawn(task_t task)
+{
+    auto self = current_pool == this ? current_worker : 0;
+    auto& worker = *workers_[self];
+    pending_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex_);
+        worker.tasks_.push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
 }
 
-const node_base_t* detail::traverse(const node_base_t* node,
-                                    pass_base_t::type_t traversal,
-                                    pass_base_t::direction_t dir) noexcept
+void parallel::thread_pool::work(unsigned self)
 {
-    return traverse(const_cast<node_base_t*>(node), traversal, dir);
+    current_pool = this;
+    current_worker = self;
+    unsigned seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        wake_.wait(lock, [this, &seen] { return stop_ || generation_ != seen; });
+        if (stop_)
+        {
+            return;
+        }
+        seen = generation_;
+        lock.unlock();
+        help(self);
+        lock.lock();
+    }
+}
+
+void parallel::thread_pool::help(unsigned self)
+{
+    bool idle = false;
+    task_t task;
+    while (pending_.load() > 0)
+    {
+        if (take(self, task))
+        {
+            if (idle)
+            {
+                idle_.fetch_sub(1);
+                idle = false;
+            }
+            execute(task);
+        }
+        else
+        {
+            if (!idle)
+            {
+                idle_.fetch_add(1);
+                idle = true;
+            }
+            std::this_thread::yield();
+        }
+    }
+    if (idle)
+    {
+        idle_.fetch_sub(1);
+    }
 }
 
-const node_base_t* detail::get_node(const pass_base_t* pass) noexcept
+bool parallel::thread_pool::take(unsigned self, task_t& task)
 {
-    if (pass->type_ == pass_base_t::type_t::LEAD)
+    // own newest first, then the oldest of the others
+    for (unsigned i = 0; i < workers_.size(); ++i)
     {
-        return static_cast<const node_base_t*>(
-            static_cast<const pass_t<pass_base_t::type_t::LEAD>*>(pass));
+        auto& worker = *workers_[(self + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex_);
+        if (!worker.tasks_.empty())
+        {
+            if (i == 0)
+            {
+                task = std::move(worker.tasks_.back());
+                worker.tasks_.pop_back();
+            }
+            else
+            {
+                task = std::move(worker.tasks_.front());
+                worker.tasks_.pop_front();
+            }
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void parallel::thread_pool::execute(task_t& task) noexcept
+{
+    if (!failed_.load(std::memory_order_relaxed))
+    {
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!failed_.exchange(true))
+            {
+                error_ = std::current_exception();
+            }
+        }
+    }
+    task = nullptr;
+    pending_.fetch_sub(1);
+}
+
+parallel::thread_pool& parallel::default_pool()
+{
+    static thread_pool pool;
+    return pool;
+}
+
+detail::epoch_domain::epoch_domain() noexcept :
+    epoch_(1)
+{
+    for (auto& slot : slots_)
+    {
+        slot.epoch_.store(idle, std::memory_order_relaxed);
+    }
+}
+
+detail::epoch_domain::~epoch_domain()
+{
+    for (auto& retired : retired_)
+    {
+        retired.deleter_(retired.object_);
+    }
+}
+
+std::size_t detail::epoch_domain::enter() noexcept
+{
+    // threads start on different slots
+    static std::atomic<std::size_t> next_hint(0);
+    thread_local std::size_t hint = next_hint.fetch_add(1, std::memory_order_relaxed);
+
+    for (std::size_t tried = 0;; ++tried)
+    {
+        auto slot = (hint + tried) % slots;
+        auto expected = idle;
+        // the epoch is stored before anything published is read
+        if (slots_[slot].epoch_.load(std::memory_order_relaxed) == idle &&
+            slots_[slot].epoch_.compare_exchange_strong(expected, epoch_.load()))
+        {
+            hint = slot;
+            return slot;
+        }
+        // all taken
+        if (tried % slots == slots - 1)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void detail::epoch_domain::leave(std::size_t slot) noexcept
+{
+    slots_[slot].epoch_.store(idle, std::memory_order_release);
+}
+
+void detail::epoch_domain::reserve()
+{
+    retired_.reserve(retired_.size() + 1);
+}
+
+void detail::epoch_domain::retire(void* object, deleter_t deleter) noexcept
+{
+    // readers that enter from now on can not get the object
+    retired_.push_back({object, deleter, epoch_.fetch_add(1)});
+}
+
+void detail::epoch_domain::reclaim() noexcept
+{
+    auto oldest = epoch_.load();
+    for (auto& slot : slots_)
+    {
+        auto epoch = slot.epoch_.load();
+        if (epoch != idle)
+        {
+            oldest = std::min(oldest, epoch);
+        }
+    }
+
+    // retired before the oldest reader came
+    auto kept = std::partition(retired_.begin(), retired_.end(),
+                               [oldest] (const retired_t& retired) { return retired.epoch_ >= oldest; });
+    for (auto retired = kept; retired != retired_.end(); ++retired)
+    {
+        retired->deleter_(retired->object_);
+    }
+    retired_.erase(kept, retired_.end());
+}
+
+std::size_t detail::euler_position(const euler_token_base_t* token) noexcept
+{
+    std::size_t position = token->left_ ? token->left_->tokens_ : 0;
+    for (; token->parent_; token = token->parent_)
+    {
+        auto parent = token->parent_;
+        if (parent->right_ == token)
+        {
+            position += 1 + (parent->left_ ? parent->left_->tokens_ : 0);
+        }
+    }
+    return position;
+}
+
+std::size_t detail::euler_rank(const euler_token_base_t* token) noexcept
+{
+    std::size_t rank = token->left_ ? token->left_->leads_ : 0;
+    for (; token->parent_; token = token->parent_)
+    {
+        auto parent = token->parent_;
+        if (parent->right_ == token)
+        {
+            rank += (parent->type_ == pass_base_t::type_t::LEAD) +
+                    (parent->left_ ? parent->left_->leads_ : 0);
+        }
+    }
+    return rank;
+}
+
+euler_token_base_t* detail::euler_first(euler_token_base_t* root) noexcept
+{
+    for (; root && root->left_; root = root->left_);
+    return root;
+}
+
+euler_token_base_t* detail::euler_last(euler_token_base_t* root) noexcept
+{
+    for (; root && root->right_; root = root->right_);
+    return root;
+}
+
+euler_token_base_t* detail::euler_next(euler_token_base_t* token) noexcept
+{
+    if (token->right_)
+    {
+        return euler_first(token->right_);
+    }
+    for (; token->parent_ && token->parent_->right_ == token; token = token->parent_);
+    return token->parent_;
+}
+
+euler_token_base_t* detail::euler_pred(euler_token_base_t* token) noexcept
+{
+    if (token->left_)
+    {
+        return euler_last(token->left_);
+    }
+    for (; token->parent_ && token->parent_->left_ == token; token = token->parent_);
+    return token->parent_;
+}
+
+euler_token_base_t* detail::euler_nth(euler_token_base_t* root, std::size_t n,
+                                      pass_base_t::type_t traversal,
+                                      node_base_t::level_t& level) noexcept
+{
+    auto lead = traversal == pass_base_t::type_t::LEAD;
+    auto counted = [lead] (const euler_token_base_t* token) -> std::size_t
+    {
+        if (!token)
+        {
+            return 0;
+        }
+        return lead ? token->leads_ : token->tokens_ - token->leads_;
+    };
+
+    // tokens and leads before node
+    std::size_t position = 0;
+    std::size_t leads = 0;
+    auto node = root;
+    while (node)
+    {
+        auto left = node->left_;
+        if (n < counted(left))
+        {
+            node = left;
+            continue;
+        }
+        n -= counted(left);
+        position += left ? left->tokens_ : 0;
+        leads += left ? left->leads_ : 0;
+        if (node->type_ == traversal && n-- == 0)
+        {
+            break;
+        }
+        position += 1;
+        leads += node->type_ == pass_base_t::type_t::LEAD;
+        node = node->right_;
+    }
+
+    // opened before it less closed before it, a lead opens its own node
+    level = node ? static_cast<node_base_t::level_t>(2 * leads - position + lead) : 0;
+    return node;
+}
+
+euler_token_base_t* detail::euler_walk(euler_token_base_t* root,
+                                       euler_token_base_t* token,
+                                       pass_base_t::type_t traversal,
+                                       pass_base_t::direction_t dir,
+                                       node_base_t::level_t& level) noexcept
+{
+    auto forward = dir == pass_base_t::direction_t::NEXT;
+    auto lead = traversal == pass_base_t::type_t::LEAD;
+    auto step = [forward] (euler_token_base_t* cur)
+    {
+        return forward ? euler_next(cur) : euler_pred(cur);
+    };
+
+    // the header's lead is before the tour and its tail after it:
+    // leaving the header, its other pass is on the way unless
+    // the lead goes forward or the tail back
+    node_base_t::level_t passed = 0;
+    euler_token_base_t* cur;
+    if (token)
+    {
+        cur = step(token);
     }
     else
     {
-        assert(pass->type_ == pass_base_t::type_t::TAIL);
-        return static_cast<const node_base_t*>(
-            static_cast<const pass_t<pass_base_t::type_t::TAIL>*>(pass));
+        passed += lead != forward;
+        cur = forward ? euler_first(root) : euler_last(root);
+    }
+    for (; cur && cur->type_ != traversal; cur = step(cur))
+    {
+        ++passed;
+    }
+    // coming to the header, the same
+    if (!cur)
+    {
+        passed += lead == forward;
+    }
+
+    if (lead == forward)
+    {
+        level = level + 1 - passed;
+    }
+    else
+    {
+        level = level - 1 + passed;
+    }
+    return cur;
+}
+
+void detail::lca_table::build(const std::vector<node_base_t::level_t>& levels)
+{
+    auto n = levels.size();
+    if (n >= none)
+    {
+        throw std::length_error("lca_index: too many nodes");
+    }
+    ends_.resize(n);
+    keys_.resize(n);
+
+    // the last node seen on every level
+    std::vector<std::uint32_t> path;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        for (; path.size() >= levels[i]; path.pop_back())
+        {
+            ends_[path.back()] = static_cast<std::uint32_t>(i);
+        }
+        auto parent = path.empty() ? none : path.back();
+        keys_[i] = static_cast<std::uint64_t>(levels[i]) << 32 | parent;
+        path.push_back(static_cast<std::uint32_t>(i));
+    }
+    for (auto node : path)
+    {
+        ends_[node] = static_cast<std::uint32_t>(n);
+    }
+
+    blocks_ = (n + block_size - 1) / block_size;
+    logs_.assign(blocks_ + 1, 0);
+    for (std::size_t i = 2; i <= blocks_; ++i)
+    {
+        logs_[i] = logs_[i / 2] + 1;
+    }
+    std::size_t rows = blocks_ ? logs_[blocks_] + 1 : 0;
+    table_.resize(rows * blocks_);
+    for (std::size_t j = 0; j < blocks_; ++j)
+    {
+        table_[j] = scan(j * block_size, std::min(n, (j + 1) * block_size));
+    }
+    for (std::size_t k = 1; k < rows; ++k)
+    {
+        auto row = table_.begin() + k * blocks_;
+        auto prev = table_.begin() + (k - 1) * blocks_;
+        std::size_t half = std::size_t(1) << (k - 1);
+        for (std::size_t j = 0; j + 2 * half <= blocks_; ++j)
+        {
+            row[j] = std::min(prev[j], prev[j + half]);
+        }
+    }
+}
+
+std::uint32_t detail::lca_table::lca(std::uint32_t lhs, std::uint32_t rhs) const noexcept
+{
+    if (lhs > rhs)
+    {
+        std::swap(lhs, rhs);
     }
+    if (is_ancestor(lhs, rhs))
+    {
+        return lhs;
+    }
+    // the shallowest ones after lhs up to rhs
+    return static_cast<std::uint32_t>(range_min(lhs + 1, rhs + 1));
 }
 
-node_base_t* detail::get_node(pass_base_t* pass) noexcept
+std::uint64_t detail::lca_table::scan(std::size_t first, std::size_t last) const noexcept
 {
-    return const_cast<node_base_t*>(get_node(static_cast<const pass_base_t*>(pass)));
+    // a plain loop, so that it gets vectorized
+    auto found = keys_[first];
+    for (auto i = first + 1; i < last; ++i)
+    {
+        found = std::min(found, keys_[i]);
+    }
+    return found;
+}
+
+std::uint64_t detail::lca_table::range_min(std::size_t first, std::size_t last) const noexcept
+{
+    auto first_block = first / block_size;
+    auto last_block = (last - 1) / block_size;
+    if (first_block == last_block)
+    {
+        return scan(first, last);
+    }
+
+    auto found = std::min(scan(first, (first_block + 1) * block_size),
+                          scan(last_block * block_size, last));
+    if (first_block + 1 < last_block)
+    {
+        auto from = first_block + 1;
+        auto count = last_block - from;
+        auto k = logs_[count];
+        auto row = table_.data() + k * blocks_;
+        found = std::min({found, row[from], row[last_block - (std::size_t(1) << k)]});
+    }
+    return found;
+}
+
+void detail::level_table::build(const std::vector<level_t>& levels)
+{
+    auto n = levels.size();
+    if (n >= none)
+    {
+        throw std::length_error("level_ancestor_index: too many nodes");
+    }
+    levels_ = levels;
+
+    // counting sort by level keeps pre-order within a level
+    level_t deepest = 0;
+    for (auto level : levels)
+    {
+        deepest = std::max(deepest, level);
+    }
+    starts_.assign(deepest + 1, 0);
+    for (auto level : levels)
+    {
+        ++starts_[level];
+    }
+    for (level_t level = 1; level <= deepest; ++level)
+    {
+        starts_[level] += starts_[level - 1];
+    }
+    by_level_.resize(n);
+    std::vector<std::uint32_t> fill(starts_.begin(), starts_.end() - 1);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        by_level_[fill[levels[i] - 1]++] = static_cast<std::uint32_t>(i);
+    }
+}
+
+std::uint32_t detail::level_table::ancestor(std::uint32_t node, level_t level) const noexcept
+{
+    if (level == 0 || level > levels_[node])
+    {
+        return none;
+    }
+    if (level == levels_[node])
+    {
+        return node;
+    }
+    auto first = by_level_.begin() + starts_[level - 1];
+    auto last = by_level_.begin() + starts_[level];
+    return *(std::upper_bound(first, last, node) - 1);
+}
+
+void detail::level_table::ancestors(const std::pair<std::uint32_t, level_t>* first,
+                                    const std::pair<std::uint32_t, level_t>* last,
+                                    std::uint32_t* out) const
+{
+    if (first == last)
+    {
+        return;
+    }
+    // a sweep costs a step a node in between, a search about
+    // a few dozen steps a query
+    constexpr std::size_t steps_per_query = 32;
+    auto queries = static_cast<std::size_t>(last - first);
+    auto from = first->first;
+    auto to = (last - 1)->first;
+    if (to - from > queries * steps_per_query)
+    {
+        for (; first != last; ++first, ++out)
+        {
+            *out = ancestor(first->first, first->second);
+        }
+        return;
+    }
+
+    // the last node seen on every level, the ancestors of from to start with
+    std::vector<std::uint32_t> path(levels_[from]);
+    for (level_t level = 1; level <= levels_[from]; ++level)
+    {
+        path[level - 1] = ancestor(from, level);
+    }
+    auto node = from;
+    for (; first != last; ++first, ++out)
+    {
+        assert(first->first >= node && "level_ancestors: queries are not sorted");
+        for (; node < first->first;)
+        {
+            ++node;
+            auto level = levels_[node];
+            if (path.size() < level)
+            {
+                path.resize(level);
+            }
+            path[level - 1] = node;
+        }
+        auto level = first->second;
+        *out = level == 0 || level > levels_[node] ? none : path[level - 1];
+    }
 }
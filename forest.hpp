@@ -3,11 +3,49 @@
 
 #include <cassert>
 #include <algorithm>
+#include <atomic>
 #include <utility>
 #include <deque>
 #include <iostream>
 #include <variant>
 #include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// carve nodes out of per-forest chunks (1)
+// or take every node from the allocator separately (0)
+#ifndef FORESTLIB_NODE_POOL
+#define FORESTLIB_NODE_POOL 1
+#endif
+
+// keep pre-order and post-order neighbours in every node (1),
+// so each iterator step is O(1) in the worst case,
+// or find them through the passes, O(1) amortized (0)
+#ifndef FORESTLIB_ORDER_THREADS
+#define FORESTLIB_ORDER_THREADS 0
+#endif
+
+// keep every level's nodes in a list in pre-order (1),
+// so level-order iteration is a walk along it,
+// or find them through the passes of the levels above (0)
+#ifndef FORESTLIB_LEVEL_THREADS
+#define FORESTLIB_LEVEL_THREADS 0
+#endif
+
+// count allocations, traversal steps, erase fix-ups and copies
+// per forest and for the whole process (1), see forest_counters,
+// or leave no trace of it (0)
+#ifndef FORESTLIB_INSTRUMENT
+#define FORESTLIB_INSTRUMENT 0
+#endif
 
 template<typename T>
 void Dump(T&& any_forest)
@@ -38,8 +76,65 @@ void Dump(T&& any_forest)
 namespace forestlib
 {
 
+// what FORESTLIB_INSTRUMENT counts, all zeros without it
+// a forest's counters travel with its nodes on swap and move;
+// iterators do not know their forest, so traversal is counted
+// only in the global ones
+struct forest_counters
+{
+    std::uint64_t nodes_allocated_ = 0;
+    std::uint64_t nodes_freed_ = 0;
+    // of the live nodes, values included
+    std::uint64_t bytes_in_use_ = 0;
+    // nodes gone to by iterators and the passes skipped on the way
+    std::uint64_t traverse_steps_ = 0;
+    std::uint64_t pass_skips_ = 0;
+    // erases of internal nodes and the nodes fixed up for them:
+    // children reparented, level threads relinked
+    std::uint64_t internal_erases_ = 0;
+    std::uint64_t erase_walk_ = 0;
+    // copies of whole forests and the nodes copied
+    std::uint64_t copies_ = 0;
+    std::uint64_t copied_nodes_ = 0;
+};
+
+// of all forests since the start or the last reset
+forest_counters global_counters() noexcept;
+void reset_global_counters() noexcept;
+
 namespace detail
 {
+#if FORESTLIB_INSTRUMENT
+    enum counter_t
+    {
+        NODES_ALLOCATED = 0,
+        NODES_FREED,
+        BYTES_IN_USE,
+        TRAVERSE_STEPS,
+        PASS_SKIPS,
+        INTERNAL_ERASES,
+        ERASE_WALK,
+        COPIES,
+        COPIED_NODES,
+        COUNTERS
+    };
+
+    extern std::atomic<std::uint64_t> global_counts[COUNTERS];
+
+    // relaxed: nothing is ordered by the counters
+    inline void count_globally(counter_t counter, std::uint64_t by = 1) noexcept
+    {
+        global_counts[counter].fetch_add(by, std::memory_order_relaxed);
+    }
+
+    inline void uncount_globally(counter_t counter, std::uint64_t by) noexcept
+    {
+        global_counts[counter].fetch_sub(by, std::memory_order_relaxed);
+    }
+
+    forest_counters make_counters(const std::uint64_t* counts) noexcept;
+#endif
+
     struct pass_base_t
     {
         enum type_t
@@ -54,8 +149,58 @@ namespace detail
             PRED
         };
 
-        pass_base_t(type_t type) noexcept :
-            type_(type), next_(nullptr), pred_(nullptr) {}
+        // pointer to a pass that keeps the pass's type in its lowest bit
+        // (passes are pointer aligned), so passes need no type field
+        class link_t
+        {
+            public:
+                link_t() noexcept :
+                    bits_(0) {}
+
+                link_t(pass_base_t* pass, type_t type) noexcept :
+                    bits_(reinterpret_cast<std::uintptr_t>(pass) | type)
+                {
+                    assert((reinterpret_cast<std::uintptr_t>(pass) & type_mask) == 0 &&
+                           "misaligned pass");
+                }
+
+                type_t type() const noexcept
+                {
+                    return static_cast<type_t>(bits_ & type_mask);
+                }
+
+                pass_base_t* get() const noexcept
+                {
+                    return reinterpret_cast<pass_base_t*>(bits_ & ~type_mask);
+                }
+
+                pass_base_t* operator->() const noexcept
+                {
+                    return get();
+                }
+
+                pass_base_t& operator*() const noexcept
+                {
+                    return *get();
+                }
+
+                friend bool operator==(link_t lhs, link_t rhs) noexcept
+                {
+                    return lhs.bits_ == rhs.bits_;
+                }
+
+                friend bool operator!=(link_t lhs, link_t rhs) noexcept
+                {
+                    return !(lhs == rhs);
+                }
+
+            private:
+                static constexpr std::uintptr_t type_mask = 1;
+
+                std::uintptr_t bits_;
+        };
+
+        pass_base_t() noexcept = default;
 
         pass_base_t(const pass_base_t&) = delete;
         pass_base_t(pass_base_t&&) = delete;
@@ -63,7 +208,7 @@ namespace detail
         pass_base_t& operator=(pass_base_t&&) = delete;
 
         // for convenience sake
-        pass_base_t* get(direction_t dir) const noexcept
+        link_t get(direction_t dir) const noexcept
         {
             if (dir == direction_t::NEXT)
             {
@@ -75,26 +220,50 @@ namespace detail
             }
         }
 
-        type_t type_;
-        pass_base_t* next_;
-        pass_base_t* pred_;
+        link_t next_;
+        link_t pred_;
     };
 
     template<pass_base_t::type_t Type>
     struct pass_t : public pass_base_t
     {
-        pass_t() : pass_base_t(Type) {}
+        pass_t() noexcept = default;
+
+        // link to this pass
+        link_t link() noexcept
+        {
+            return link_t(this, Type);
+        }
     };
 
+    // node keeps no level: it is the number of lead passes
+    // minus the number of tail passes on the way from header,
+    // so iterators count it while traversing and erasing
+    // an internal node does not touch its subtree
     struct node_base_t : public pass_t<pass_base_t::type_t::LEAD>,
                          public pass_t<pass_base_t::type_t::TAIL>
     {
         using level_t = unsigned;
+        using level_shift_t = int;
 
-        node_base_t(level_t level = 0) noexcept :
+        node_base_t() noexcept :
             pass_t<pass_base_t::type_t::LEAD>(),
             pass_t<pass_base_t::type_t::TAIL>(),
-            level_(level) {}
+            parent_(nullptr)
+        {
+#if FORESTLIB_ORDER_THREADS
+            for (auto order : {pass_base_t::type_t::LEAD, pass_base_t::type_t::TAIL})
+            {
+                order_next_[order] = this;
+                order_pred_[order] = this;
+                order_shift_[order] = 0;
+            }
+#endif
+#if FORESTLIB_LEVEL_THREADS
+            level_next_ = nullptr;
+            level_pred_ = nullptr;
+#endif
+        }
 
         node_base_t(const node_base_t& rhs) = delete;
         node_base_t(node_base_t&& rhs) = delete;
@@ -141,41 +310,550 @@ namespace detail
             return const_cast<node_base_t*>(this)->get_pass(type);
         }
 
-        level_t level_;
+        // tagged links to the passes
+        pass_base_t::link_t get_lead_link() noexcept
+        {
+            return static_cast<pass_t<pass_base_t::type_t::LEAD>&>(*this).link();
+        }
+
+        pass_base_t::link_t get_tail_link() noexcept
+        {
+            return static_cast<pass_t<pass_base_t::type_t::TAIL>&>(*this).link();
+        }
+
+        // header for roots, nullptr for header
+        node_base_t* parent_;
+
+#if FORESTLIB_ORDER_THREADS
+        // neighbours in pre-order (indexed by LEAD)
+        // and post-order (indexed by TAIL), header included;
+        // shift is the next node's level minus this one's
+        node_base_t* order_next_[2];
+        node_base_t* order_pred_[2];
+        level_shift_t order_shift_[2];
+#endif
+
+#if FORESTLIB_LEVEL_THREADS
+        // neighbours on the same level in pre-order,
+        // nullptr at the ends of the level
+        node_base_t* level_next_;
+        node_base_t* level_pred_;
+#endif
     };
 
+    // payload is constructed and destroyed by the owner
+    // through its allocator (see forest::construct_node)
     template<typename T>
     struct node_t : public node_base_t
     {
-        using level_t = node_base_t::level_t;
+        node_t() noexcept :
+            node_base_t() {}
 
-        node_t(const T& data, level_t level = 0) :
-            node_base_t(level), data_(data) {}
+        ~node_t() {}
 
-        node_t(T&& data, level_t level = 0) :
-            node_base_t(level), data_(std::move(data)) {}
+        union
+        {
+            T data_;
+        };
+    };
 
-        T data_;
+#if FORESTLIB_LEVEL_THREADS
+    // the ends of a level's list, nullptr for an empty one
+    struct level_thread_t
+    {
+        node_base_t* head_ = nullptr;
+        node_base_t* tail_ = nullptr;
     };
+#endif
 
     struct header_t : public node_base_t
     {
         header_t() :
             node_base_t() {}
+
+#if FORESTLIB_LEVEL_THREADS
+        // level l is levels_[l - 1], no empty ones at the back;
+        // travels with the header, so it is not taken from the forest's allocator
+        std::vector<level_thread_t> levels_;
+#endif
+    };
+
+#if FORESTLIB_NODE_POOL
+    // slab allocator for nodes
+    // carves fixed-size blocks out of big chunks taken from Alloc,
+    // freed blocks are kept in an intrusive free list
+    // so nodes allocated together have nearby addresses
+    template<typename Node, typename Alloc>
+    class node_pool
+    {
+        union slot_t
+        {
+            // bookkeeping of a chunk, lives in its first slot
+            struct chunk_t
+            {
+                slot_t* next_;
+                std::size_t size_;
+            };
+
+            slot_t* next_free_;
+            chunk_t chunk_;
+            alignas(Node) unsigned char storage_[sizeof(Node)];
+        };
+
+        using slot_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<slot_t>;
+        using slot_traits_t = std::allocator_traits<slot_alloc_t>;
+
+        static_assert(std::is_pointer_v<typename slot_traits_t::pointer>,
+                      "fancy pointers are not supported");
+
+        static constexpr std::size_t first_chunk_size = 64;
+        static constexpr std::size_t max_chunk_size = 8192;
+
+        public:
+            // release() frees every node, allocated or not
+            static constexpr bool releases_in_bulk = true;
+
+            explicit node_pool(const Alloc& alloc) noexcept :
+                alloc_(alloc), chunks_(nullptr), free_(nullptr),
+                bump_(nullptr), bump_end_(nullptr),
+                next_chunk_size_(first_chunk_size) {}
+
+            node_pool(const node_pool&) = delete;
+            node_pool& operator=(const node_pool&) = delete;
+
+            // chunks go together with (a copy of) the allocator they came from
+            node_pool(node_pool&& rhs) noexcept : node_pool(rhs.get_allocator())
+            {
+                swap_storage(*this, rhs);
+            }
+
+            node_pool& operator=(node_pool&&) = delete;
+
+            ~node_pool() noexcept
+            {
+                release();
+            }
+
+            Alloc get_allocator() const noexcept
+            {
+                return Alloc(alloc_);
+            }
+
+            // returns raw storage for one node
+            Node* allocate()
+            {
+                if (free_)
+                {
+                    auto slot = free_;
+                    free_ = slot->next_free_;
+                    return reinterpret_cast<Node*>(slot->storage_);
+                }
+                if (bump_ == bump_end_)
+                {
+                    add_chunk();
+                }
+                return reinterpret_cast<Node*>((bump_++)->storage_);
+            }
+
+            // makes room for n more nodes in one block
+            // they are allocated one after another if free list is empty
+            void reserve(std::size_t n)
+            {
+                if (static_cast<std::size_t>(bump_end_ - bump_) >= n)
+                {
+                    return;
+                }
+                // first slot is taken by bookkeeping
+                auto chunk = new_chunk(std::max(n + 1, next_chunk_size_));
+                // what's left of the current chunk is not lost
+                for (; bump_ != bump_end_; ++bump_)
+                {
+                    bump_->next_free_ = free_;
+                    free_ = bump_;
+                }
+                use_chunk(chunk);
+            }
+
+            // node must be already destroyed
+            void deallocate(Node* node) noexcept
+            {
+                auto slot = reinterpret_cast<slot_t*>(node);
+                slot->next_free_ = free_;
+                free_ = slot;
+            }
+
+            // gives all the chunks back
+            // every node must be already destroyed
+            void release() noexcept
+            {
+                while (chunks_)
+                {
+                    auto chunk = chunks_;
+                    chunks_ = chunk->chunk_.next_;
+                    slot_traits_t::deallocate(alloc_, chunk, chunk->chunk_.size_);
+                }
+                free_ = bump_ = bump_end_ = nullptr;
+                next_chunk_size_ = first_chunk_size;
+            }
+
+            friend void swap(node_pool& lhs, node_pool& rhs) noexcept
+            {
+                using std::swap;
+                swap(lhs.alloc_, rhs.alloc_);
+                swap_storage(lhs, rhs);
+            }
+
+            // allocators are kept, so they must be equal
+            friend void swap_storage(node_pool& lhs, node_pool& rhs) noexcept
+            {
+                std::swap(lhs.chunks_, rhs.chunks_);
+                std::swap(lhs.free_, rhs.free_);
+                std::swap(lhs.bump_, rhs.bump_);
+                std::swap(lhs.bump_end_, rhs.bump_end_);
+                std::swap(lhs.next_chunk_size_, rhs.next_chunk_size_);
+            }
+
+        private:
+            void add_chunk()
+            {
+                use_chunk(new_chunk(next_chunk_size_));
+                next_chunk_size_ = std::min(2 * next_chunk_size_, max_chunk_size);
+            }
+
+            slot_t* new_chunk(std::size_t size)
+            {
+                auto chunk = slot_traits_t::allocate(alloc_, size);
+                chunk->chunk_.size_ = size;
+                return chunk;
+            }
+
+            // chunk becomes the current one
+            void use_chunk(slot_t* chunk) noexcept
+            {
+                chunk->chunk_.next_ = chunks_;
+                chunks_ = chunk;
+                // first slot is taken by bookkeeping
+                bump_ = chunk + 1;
+                bump_end_ = chunk + chunk->chunk_.size_;
+            }
+
+            slot_alloc_t alloc_;
+            slot_t* chunks_;
+            slot_t* free_;
+            slot_t* bump_;
+            slot_t* bump_end_;
+            std::size_t next_chunk_size_;
+    };
+#else
+    // every node is taken from Alloc separately
+    template<typename Node, typename Alloc>
+    class node_pool
+    {
+        using node_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+        using node_traits_t = std::allocator_traits<node_alloc_t>;
+
+        static_assert(std::is_pointer_v<typename node_traits_t::pointer>,
+                      "fancy pointers are not supported");
+
+        public:
+            // release() frees nothing
+            static constexpr bool releases_in_bulk = false;
+
+            explicit node_pool(const Alloc& alloc) noexcept :
+                alloc_(alloc) {}
+
+            node_pool(const node_pool&) = delete;
+            node_pool& operator=(const node_pool&) = delete;
+
+            node_pool(node_pool&& rhs) noexcept :
+                alloc_(rhs.alloc_) {}
+
+            node_pool& operator=(node_pool&&) = delete;
+
+            Alloc get_allocator() const noexcept
+            {
+                return Alloc(alloc_);
+            }
+
+            Node* allocate()
+            {
+                return node_traits_t::allocate(alloc_, 1);
+            }
+
+            void deallocate(Node* node) noexcept
+            {
+                node_traits_t::deallocate(alloc_, node, 1);
+            }
+
+            // nodes are separate anyway
+            void reserve(std::size_t) noexcept {}
+
+            void release() noexcept {}
+
+            friend void swap(node_pool& lhs, node_pool& rhs) noexcept
+            {
+                using std::swap;
+                swap(lhs.alloc_, rhs.alloc_);
+            }
+
+            // nothing but allocators to swap
+            friend void swap_storage(node_pool&, node_pool&) noexcept {}
+
+        private:
+            node_alloc_t alloc_;
     };
+#endif
+
+    constexpr pass_base_t::type_t opposite_pass_type(pass_base_t::type_t type) noexcept
+    {
+        return type == pass_base_t::type_t::LEAD ? pass_base_t::type_t::TAIL : pass_base_t::type_t::LEAD;
+    }
+
+    // node the linked pass belongs to
+    inline node_base_t* get_node(pass_base_t::link_t link) noexcept
+    {
+        if (link.type() == pass_base_t::type_t::LEAD)
+        {
+            return static_cast<node_base_t*>(
+                static_cast<pass_t<pass_base_t::type_t::LEAD>*>(link.get()));
+        }
+        else
+        {
+            assert(link.type() == pass_base_t::type_t::TAIL);
+            return static_cast<node_base_t*>(
+                static_cast<pass_t<pass_base_t::type_t::TAIL>*>(link.get()));
+        }
+    }
+
+    // order and direction are template arguments in the step functions below,
+    // so every branch on them is gone and the loop over passes is inlined
+    // into the caller; the ones taking them at run time pick one of these
+
+    // the same as traverse, but always goes through the passes
+    // (no order threads), O(1) amortized
+    // level is node's level on input and the returned node's one on output
+    template<pass_base_t::type_t Traversal, pass_base_t::direction_t Direction>
+    inline node_base_t* walk(node_base_t* node, node_base_t::level_t& level) noexcept
+    {
+        constexpr auto opposite_type = opposite_pass_type(Traversal);
+        constexpr bool next = Direction == pass_base_t::direction_t::NEXT;
+
+        // passing edges leading to opposite pass
+        // every passed one is a level up (tail pass) or down (lead pass)
+        node_base_t::level_t passed = 0;
+        auto& pass = static_cast<pass_t<Traversal>&>(*node);
+        auto cur_pass = next ? pass.next_ : pass.pred_;
+        for (;cur_pass.type() == opposite_type;
+             cur_pass = next ? cur_pass->next_ : cur_pass->pred_)
+        {
+            ++passed;
+        }
+#if FORESTLIB_INSTRUMENT
+        count_globally(PASS_SKIPS, passed);
+#endif
+
+        assert(cur_pass.type() == Traversal);
+        // with nothing passed next pre-order (previous post-order) node
+        // is a child, previous pre-order (next post-order) one is the parent
+        if constexpr ((Traversal == pass_base_t::type_t::LEAD) == next)
+        {
+            level = level + 1 - passed;
+        }
+        else
+        {
+            level = level - 1 + passed;
+        }
+        return get_node(cur_pass);
+    }
+
+    template<pass_base_t::type_t Traversal, pass_base_t::direction_t Direction>
+    inline node_base_t* traverse(node_base_t* node, node_base_t::level_t& level) noexcept
+    {
+#if FORESTLIB_INSTRUMENT
+        count_globally(TRAVERSE_STEPS);
+#endif
+#if FORESTLIB_ORDER_THREADS
+        if constexpr (Direction == pass_base_t::direction_t::NEXT)
+        {
+            level += node->order_shift_[Traversal];
+            return node->order_next_[Traversal];
+        }
+        else
+        {
+            auto pred = node->order_pred_[Traversal];
+            level -= pred->order_shift_[Traversal];
+            return pred;
+        }
+#else
+        return walk<Traversal, Direction>(node, level);
+#endif
+    }
+
+    // level is node's level on input and the returned node's one on output
+    inline node_base_t* traverse(node_base_t* node,
+                                 pass_base_t::type_t traversal,
+                                 pass_base_t::direction_t direction,
+                                 node_base_t::level_t& level) noexcept
+    {
+        using type_t = pass_base_t::type_t;
+        using direction_t = pass_base_t::direction_t;
+
+        if (traversal == type_t::LEAD)
+        {
+            return direction == direction_t::NEXT ? traverse<type_t::LEAD, direction_t::NEXT>(node, level) :
+                                                    traverse<type_t::LEAD, direction_t::PRED>(node, level);
+        }
+        else
+        {
+            return direction == direction_t::NEXT ? traverse<type_t::TAIL, direction_t::NEXT>(node, level) :
+                                                    traverse<type_t::TAIL, direction_t::PRED>(node, level);
+        }
+    }
+
+    inline const node_base_t* traverse(const node_base_t* node,
+                                       pass_base_t::type_t traversal,
+                                       pass_base_t::direction_t direction,
+                                       node_base_t::level_t& level) noexcept
+    {
+        return traverse(const_cast<node_base_t*>(node), traversal, direction, level);
+    }
+
+    // the level is not needed, the compiler drops it
+    inline node_base_t* traverse(node_base_t* node,
+                                 pass_base_t::type_t traversal,
+                                 pass_base_t::direction_t direction) noexcept
+    {
+        node_base_t::level_t level = 0;
+        return traverse(node, traversal, direction, level);
+    }
+
+    inline const node_base_t* traverse(const node_base_t* node,
+                                       pass_base_t::type_t traversal,
+                                       pass_base_t::direction_t direction) noexcept
+    {
+        return traverse(const_cast<node_base_t*>(node), traversal, direction);
+    }
+
+    inline node_base_t* walk(node_base_t* node,
+                             pass_base_t::type_t traversal,
+                             pass_base_t::direction_t direction,
+                             node_base_t::level_t& level) noexcept
+    {
+        using type_t = pass_base_t::type_t;
+        using direction_t = pass_base_t::direction_t;
+
+        if (traversal == type_t::LEAD)
+        {
+            return direction == direction_t::NEXT ? walk<type_t::LEAD, direction_t::NEXT>(node, level) :
+                                                    walk<type_t::LEAD, direction_t::PRED>(node, level);
+        }
+        else
+        {
+            return direction == direction_t::NEXT ? walk<type_t::TAIL, direction_t::NEXT>(node, level) :
+                                                    walk<type_t::TAIL, direction_t::PRED>(node, level);
+        }
+    }
+
+#if FORESTLIB_ORDER_THREADS
+    // order threads upkeep
+    // leaf's passes must be already linked, anywhere among its siblings
+    void thread_leaf(node_base_t* leaf) noexcept;
+    // both are called before node's passes are unlinked
+    void unthread_leaf(node_base_t* leaf) noexcept;
+    void unthread_internal(node_base_t* node) noexcept;
+#endif
+
+#if FORESTLIB_LEVEL_THREADS
+    // level threads upkeep
+    // leaf's passes must be already linked, anywhere among its siblings:
+    // O(1) unless it is an only child in the middle of its level,
+    // then nodes on parent's level are looked through for the nearest
+    // ones with children both ways at once
+    void thread_level(node_base_t* leaf, level_thread_t& level) noexcept;
+    // both are called before node's passes are unlinked
+    void unthread_level_leaf(node_base_t* leaf, level_thread_t& level) noexcept;
+    // node's descendants go a level up, so each level below gives its run
+    // of them to the level above: O(subtree), levels points to node's one;
+    // returns how many nodes it looked through
+    std::size_t unthread_level_internal(node_base_t* node, level_thread_t* levels) noexcept;
+#endif
+
+    // the first node on level in pre-order, nullptr if there is none
+    // the next one on node's level after it, nullptr past the last one
+    // without level threads both walk the levels above in pre-order
+    node_base_t* first_on_level(node_base_t* header, node_base_t::level_t level) noexcept;
+    const node_base_t* first_on_level(const node_base_t* header, node_base_t::level_t level) noexcept;
+    node_base_t* next_on_level(node_base_t* node, node_base_t::level_t level) noexcept;
+    const node_base_t* next_on_level(const node_base_t* node, node_base_t::level_t level) noexcept;
+
+    // first node after node's subtree in pre-order
+    // level is node's level on input and the returned node's one on output
+    node_base_t* skip_subtree(node_base_t* node, node_base_t::level_t& level) noexcept;
+    const node_base_t* skip_subtree(const node_base_t* node, node_base_t::level_t& level) noexcept;
+
+    // pre-order index of every node's parent (size for roots)
+    // found from levels by an all nearest smaller values scan
+    // over blocks on up to `threads` threads
+    // throws std::invalid_argument if levels are not a pre-order
+    std::vector<std::size_t> preorder_parents(const node_base_t::level_t* levels,
+                                              std::size_t size, unsigned threads);
+
+    // neighbours of a node, nullptr if there is no such one
+    // (siblings of roots are roots)
+    inline node_base_t* first_child(node_base_t* node) noexcept
+    {
+        auto pass = node->get_lead_pass().next_;
+        return pass.type() == pass_base_t::type_t::LEAD ? get_node(pass) : nullptr;
+    }
+
+    inline node_base_t* last_child(node_base_t* node) noexcept
+    {
+        auto pass = node->get_tail_pass().pred_;
+        return pass.type() == pass_base_t::type_t::TAIL ? get_node(pass) : nullptr;
+    }
+
+    inline node_base_t* next_sibling(node_base_t* node) noexcept
+    {
+        auto pass = node->get_tail_pass().next_;
+        return pass.type() == pass_base_t::type_t::LEAD ? get_node(pass) : nullptr;
+    }
 
-    pass_base_t::type_t opposite_pass_type(pass_base_t::type_t type) noexcept;
+    inline node_base_t* prev_sibling(node_base_t* node) noexcept
+    {
+        auto pass = node->get_lead_pass().pred_;
+        return pass.type() == pass_base_t::type_t::TAIL ? get_node(pass) : nullptr;
+    }
+
+    inline const node_base_t* first_child(const node_base_t* node) noexcept
+    {
+        return first_child(const_cast<node_base_t*>(node));
+    }
+
+    inline const node_base_t* last_child(const node_base_t* node) noexcept
+    {
+        return last_child(const_cast<node_base_t*>(node));
+    }
 
-    node_base_t* traverse(node_base_t* node,
-                          pass_base_t::type_t traversal,
-                          pass_base_t::direction_t direction) noexcept;
+    inline const node_base_t* next_sibling(const node_base_t* node) noexcept
+    {
+        return next_sibling(const_cast<node_base_t*>(node));
+    }
 
-    const node_base_t* traverse(const node_base_t* node,
-                                pass_base_t::type_t traversal,
-                                pass_base_t::direction_t direction) noexcept;
+    inline const node_base_t* prev_sibling(const node_base_t* node) noexcept
+    {
+        return prev_sibling(const_cast<node_base_t*>(node));
+    }
 
-    node_base_t* get_node(pass_base_t* pass) noexcept;
-    const node_base_t* get_node(const pass_base_t* pass) noexcept;
+    // node's level counted up through the parents, O(level)
+    inline node_base_t::level_t level_of(const node_base_t* node) noexcept
+    {
+        node_base_t::level_t level = 0;
+        for (; node->parent_; node = node->parent_)
+        {
+            ++level;
+        }
+        return level;
+    }
 }
 
 template<typename T>
@@ -200,9 +878,15 @@ struct forest_iterator
     //};
 
     using traversal_t = detail::pass_base_t::type_t;
+    using level_t = detail::node_base_t::level_t;
 
-    forest_iterator(node_base_t* node, traversal_t traversal) noexcept :
-        node_(node), traversal_(traversal) {}
+    // level is counted on the way, epoch is the forest's level epoch
+    // it is counted in: erasing an internal node moves its subtree
+    // a level up and starts a new epoch, so forest::get_level knows
+    // a stale level and counts it again from the node
+    forest_iterator(node_base_t* node, traversal_t traversal, level_t level,
+                    std::uint64_t epoch = 0) noexcept :
+        node_(node), traversal_(traversal), level_(level), epoch_(epoch) {}
 
     reference operator*() const noexcept
     {
@@ -216,7 +900,7 @@ struct forest_iterator
 
     forest_iterator& operator++() noexcept
     {
-        node_ = detail::traverse(node_, traversal_, direction_t::NEXT);
+        node_ = detail::traverse(node_, traversal_, direction_t::NEXT, level_);
         return *this;
     }
 
@@ -229,7 +913,7 @@ struct forest_iterator
 
     forest_iterator& operator--() noexcept
     {
-        node_ = detail::traverse(node_, traversal_, direction_t::PRED);
+        node_ = detail::traverse(node_, traversal_, direction_t::PRED, level_);
         return *this;
     }
 
@@ -240,6 +924,65 @@ struct forest_iterator
         return tmp;
     }
 
+    // navigation keeps the traversal
+    // root's parent is the header, i.e. end()
+    forest_iterator parent() const noexcept
+    {
+        return forest_iterator(node_->parent_, traversal_, level_ - 1, epoch_);
+    }
+
+    bool has_next_sibling() const noexcept
+    {
+        return detail::next_sibling(node_) != nullptr;
+    }
+
+    bool has_prev_sibling() const noexcept
+    {
+        return detail::prev_sibling(node_) != nullptr;
+    }
+
+    // node must have children
+    forest_iterator first_child() const noexcept
+    {
+        assert(detail::first_child(node_) && "leaf has no children");
+        return forest_iterator(detail::first_child(node_), traversal_, level_ + 1, epoch_);
+    }
+
+    // node must have children
+    forest_iterator last_child() const noexcept
+    {
+        assert(detail::last_child(node_) && "leaf has no children");
+        return forest_iterator(detail::last_child(node_), traversal_, level_ + 1, epoch_);
+    }
+
+    // node must have one
+    forest_iterator next_sibling() const noexcept
+    {
+        assert(has_next_sibling() && "no next sibling");
+        return forest_iterator(detail::next_sibling(node_), traversal_, level_, epoch_);
+    }
+
+    // node must have one
+    forest_iterator prev_sibling() const noexcept
+    {
+        assert(has_prev_sibling() && "no previous sibling");
+        return forest_iterator(detail::prev_sibling(node_), traversal_, level_, epoch_);
+    }
+
+    // first node that is not in node's subtree:
+    // a jump through the tail pass in pre-order,
+    // in post-order subtree is behind, so it is just the next node
+    forest_iterator skip_subtree() const noexcept
+    {
+        if (traversal_ == traversal_t::TAIL)
+        {
+            return ++forest_iterator(*this);
+        }
+        auto level = level_;
+        auto node = detail::skip_subtree(node_, level);
+        return forest_iterator(node, traversal_, level, epoch_);
+    }
+
     friend bool operator==(const forest_iterator& lhs, const forest_iterator& rhs) noexcept
     {
         return lhs.node_ == rhs.node_ &&
@@ -253,6 +996,8 @@ struct forest_iterator
 
     node_base_t* node_;
     traversal_t traversal_;
+    level_t level_;
+    std::uint64_t epoch_;
 };
 
 template<typename T>
@@ -270,9 +1015,15 @@ struct const_forest_iterator
     using direction_t = detail::pass_base_t::direction_t;
 
     using traversal_t = detail::pass_base_t::type_t;
+    using level_t = detail::node_base_t::level_t;
 
-    const_forest_iterator(const node_base_t* node, traversal_t traversal) noexcept :
-        node_(node), traversal_(traversal) {}
+    // see forest_iterator
+    const_forest_iterator(const node_base_t* node, traversal_t traversal, level_t level,
+                          std::uint64_t epoch = 0) noexcept :
+        node_(node), traversal_(traversal), level_(level), epoch_(epoch) {}
+
+    const_forest_iterator(const forest_iterator<T>& it) noexcept :
+        node_(it.node_), traversal_(it.traversal_), level_(it.level_), epoch_(it.epoch_) {}
 
     reference operator*() const noexcept
     {
@@ -286,7 +1037,7 @@ struct const_forest_iterator
 
     const_forest_iterator& operator++() noexcept
     {
-        node_ = traverse(node_, traversal_, direction_t::NEXT);
+        node_ = traverse(node_, traversal_, direction_t::NEXT, level_);
         return *this;
     }
 
@@ -299,7 +1050,7 @@ struct const_forest_iterator
 
     const_forest_iterator& operator--() noexcept
     {
-        node_ = traverse(node_, traversal_, direction_t::PRED);
+        node_ = traverse(node_, traversal_, direction_t::PRED, level_);
         return *this;
     }
 
@@ -310,10 +1061,69 @@ struct const_forest_iterator
         return tmp;
     }
 
-    friend bool operator==(const const_forest_iterator& lhs, const const_forest_iterator& rhs) noexcept
+    // navigation keeps the traversal
+    // root's parent is the header, i.e. end()
+    const_forest_iterator parent() const noexcept
     {
-        return lhs.node_ == rhs.node_ &&
-               lhs.traversal_ == rhs.traversal_;
+        return const_forest_iterator(node_->parent_, traversal_, level_ - 1, epoch_);
+    }
+
+    bool has_next_sibling() const noexcept
+    {
+        return detail::next_sibling(node_) != nullptr;
+    }
+
+    bool has_prev_sibling() const noexcept
+    {
+        return detail::prev_sibling(node_) != nullptr;
+    }
+
+    // node must have children
+    const_forest_iterator first_child() const noexcept
+    {
+        assert(detail::first_child(node_) && "leaf has no children");
+        return const_forest_iterator(detail::first_child(node_), traversal_, level_ + 1, epoch_);
+    }
+
+    // node must have children
+    const_forest_iterator last_child() const noexcept
+    {
+        assert(detail::last_child(node_) && "leaf has no children");
+        return const_forest_iterator(detail::last_child(node_), traversal_, level_ + 1, epoch_);
+    }
+
+    // node must have one
+    const_forest_iterator next_sibling() const noexcept
+    {
+        assert(has_next_sibling() && "no next sibling");
+        return const_forest_iterator(detail::next_sibling(node_), traversal_, level_, epoch_);
+    }
+
+    // node must have one
+    const_forest_iterator prev_sibling() const noexcept
+    {
+        assert(has_prev_sibling() && "no previous sibling");
+        return const_forest_iterator(detail::prev_sibling(node_), traversal_, level_, epoch_);
+    }
+
+    // first node that is not in node's subtree:
+    // a jump through the tail pass in pre-order,
+    // in post-order subtree is behind, so it is just the next node
+    const_forest_iterator skip_subtree() const noexcept
+    {
+        if (traversal_ == traversal_t::TAIL)
+        {
+            return ++const_forest_iterator(*this);
+        }
+        auto level = level_;
+        auto node = detail::skip_subtree(node_, level);
+        return const_forest_iterator(node, traversal_, level, epoch_);
+    }
+
+    friend bool operator==(const const_forest_iterator& lhs, const const_forest_iterator& rhs) noexcept
+    {
+        return lhs.node_ == rhs.node_ &&
+               lhs.traversal_ == rhs.traversal_;
     }
 
     friend bool operator!=(const const_forest_iterator& lhs, const const_forest_iterator& rhs) noexcept
@@ -323,6 +1133,218 @@ struct const_forest_iterator
 
     const node_base_t* node_;
     traversal_t traversal_;
+    level_t level_;
+    std::uint64_t epoch_;
+};
+
+// iterates over children of a node,
+// the node itself stands for the end
+template<typename Iter>
+struct sibling_iterator
+{
+    using difference_type = ptrdiff_t;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename Iter::value_type;
+    using pointer = typename Iter::pointer;
+    using reference = typename Iter::reference;
+
+    sibling_iterator(Iter pos, Iter parent) noexcept :
+        pos_(pos), parent_(parent.node_) {}
+
+    reference operator*() const noexcept
+    {
+        return *pos_;
+    }
+
+    pointer operator->() const noexcept
+    {
+        return pos_.operator->();
+    }
+
+    sibling_iterator& operator++() noexcept
+    {
+        pos_ = pos_.has_next_sibling() ? pos_.next_sibling() : pos_.parent();
+        return *this;
+    }
+
+    sibling_iterator operator++(int) noexcept
+    {
+        auto tmp = *this;
+        ++(*this);
+        return tmp;
+    }
+
+    sibling_iterator& operator--() noexcept
+    {
+        pos_ = pos_.node_ == parent_ ? pos_.last_child() : pos_.prev_sibling();
+        return *this;
+    }
+
+    sibling_iterator operator--(int) noexcept
+    {
+        auto tmp = *this;
+        --(*this);
+        return tmp;
+    }
+
+    // the child as a forest iterator
+    Iter base() const noexcept
+    {
+        return pos_;
+    }
+
+    friend bool operator==(const sibling_iterator& lhs, const sibling_iterator& rhs) noexcept
+    {
+        return lhs.pos_ == rhs.pos_;
+    }
+
+    friend bool operator!=(const sibling_iterator& lhs, const sibling_iterator& rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+    private:
+        Iter pos_;
+        decltype(Iter::node_) parent_;
+};
+
+template<typename Iter>
+struct children_view
+{
+    using iterator = sibling_iterator<Iter>;
+
+    children_view(Iter parent) noexcept :
+        parent_(parent) {}
+
+    iterator begin() const noexcept
+    {
+        if (detail::first_child(parent_.node_))
+        {
+            return iterator(parent_.first_child(), parent_);
+        }
+        return end();
+    }
+
+    iterator end() const noexcept
+    {
+        return iterator(parent_, parent_);
+    }
+
+    bool empty() const noexcept
+    {
+        return begin() == end();
+    }
+
+    private:
+        Iter parent_;
+};
+
+// iterates over the nodes of one level or of all levels from the roots
+// down, each level in pre-order; the header stands for the end
+template<typename Iter>
+struct level_iterator
+{
+    using difference_type = ptrdiff_t;
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename Iter::value_type;
+    using pointer = typename Iter::pointer;
+    using reference = typename Iter::reference;
+    using level_t = typename Iter::level_t;
+
+    // pos is the header for the end, one_level tells if
+    // the iterator stops at the end of pos's level
+    level_iterator(Iter pos, decltype(Iter::node_) header, bool one_level) noexcept :
+        pos_(pos), header_(header), one_level_(one_level) {}
+
+    reference operator*() const noexcept
+    {
+        return *pos_;
+    }
+
+    pointer operator->() const noexcept
+    {
+        return pos_.operator->();
+    }
+
+    level_iterator& operator++() noexcept
+    {
+        auto node = detail::next_on_level(pos_.node_, pos_.level_);
+        if (!node && !one_level_)
+        {
+            node = detail::first_on_level(header_, ++pos_.level_);
+        }
+        pos_.node_ = node ? node : header_;
+        if (!node)
+        {
+            pos_.level_ = 0;
+        }
+        return *this;
+    }
+
+    level_iterator operator++(int) noexcept
+    {
+        auto tmp = *this;
+        ++(*this);
+        return tmp;
+    }
+
+    // the node as a forest iterator
+    Iter base() const noexcept
+    {
+        return pos_;
+    }
+
+    friend bool operator==(const level_iterator& lhs, const level_iterator& rhs) noexcept
+    {
+        return lhs.pos_ == rhs.pos_;
+    }
+
+    friend bool operator!=(const level_iterator& lhs, const level_iterator& rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+    private:
+        Iter pos_;
+        decltype(Iter::node_) header_;
+        bool one_level_;
+};
+
+// nodes of one level or of all levels from level on, see level_iterator
+// with level threads every step is O(1), without them a level costs
+// a walk over the levels above it, no memory is taken either way
+template<typename Iter>
+struct level_order_view
+{
+    using iterator = level_iterator<Iter>;
+    using level_t = typename Iter::level_t;
+
+    level_order_view(Iter end, level_t level, bool one_level) noexcept :
+        end_(end), level_(level), one_level_(one_level) {}
+
+    iterator begin() const noexcept
+    {
+        if (auto first = detail::first_on_level(end_.node_, level_))
+        {
+            return iterator(Iter(first, end_.traversal_, level_, end_.epoch_), end_.node_, one_level_);
+        }
+        return end();
+    }
+
+    iterator end() const noexcept
+    {
+        return iterator(end_, end_.node_, one_level_);
+    }
+
+    bool empty() const noexcept
+    {
+        return begin() == end();
+    }
+
+    private:
+        Iter end_;
+        level_t level_;
+        bool one_level_;
 };
 
 template<typename T>
@@ -331,12 +1353,12 @@ struct post_order
     using iterator = forest_iterator<T>;
     using header_t = detail::header_t;
 
-    post_order(header_t* header) noexcept :
-        header_(header) {}
+    post_order(header_t* header, std::uint64_t epoch) noexcept :
+        header_(header), epoch_(epoch) {}
 
     iterator end() noexcept
     {
-        return iterator(header_, iterator::traversal_t::TAIL);
+        return iterator(header_, iterator::traversal_t::TAIL, 0, epoch_);
     }
 
     iterator begin() noexcept
@@ -347,86 +1369,169 @@ struct post_order
 
     private:
         header_t* header_;
+        std::uint64_t epoch_;
 };
 
+// how values are written by forest::save and read by forest::load
+// trivially copyable ones are copied as raw bytes, a column per chunk,
+// other types need a specialization with
+//   static constexpr bool raw = false;
+//   static void write(std::ostream& out, const T& value);
+//   static T read(std::istream& in);
 template<typename T>
-struct forest
+struct codec
 {
-    using iterator = forest_iterator<T>;
-    using const_iterator = const_forest_iterator<T>;
-    using level_t = detail::node_base_t::level_t;
+    static_assert(std::is_trivially_copyable_v<T>, "forest: no codec to save T");
+
+    static constexpr bool raw = true;
+};
 
-    forest() : header_(new header_t), size_(0)
+namespace detail
+{
+    // unsigned LEB128
+    void write_varint(std::ostream& out, std::uint64_t value);
+    // throws std::runtime_error if the stream ends or the varint is too long
+    std::uint64_t read_varint(std::istream& in);
+
+    inline void put_varint(std::vector<char>& buffer, std::uint64_t value)
     {
-        make_header(header_);
-        make_leaf(header_);
+        for (; value >= 0x80; value >>= 7)
+        {
+            buffer.push_back(static_cast<char>(value | 0x80));
+        }
+        buffer.push_back(static_cast<char>(value));
     }
 
-    forest(const forest& rhs) : forest()
+    // throws std::runtime_error if the buffer ends
+    inline std::uint64_t get_varint(const char*& pos, const char* end)
     {
-        // for exeption safety
-        forest tmp;
+        std::uint64_t value = 0;
+        for (unsigned shift = 0; pos != end && shift < 64; shift += 7)
+        {
+            auto byte = static_cast<unsigned char>(*pos++);
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return value;
+            }
+        }
+        throw std::runtime_error("forest: corrupt stream");
+    }
 
-        // parent of insertable node
-        // starting from header_ (insert(end(), first))
-        node_base_t* cur_parent = tmp.header_;
-        // previously inserted node
-        node_base_t* last_inserted = nullptr;
+    struct stream_header_t
+    {
+        // values are raw bytes of sizeof value_size_
+        bool raw_;
+        std::uint64_t value_size_;
+        std::uint64_t size_;
+        std::uint64_t chunk_size_;
+    };
 
-        auto tmp_insert_helper = [&tmp] (auto it, node_base_t* cur_parent) mutable
-            {
-                auto pos = iterator(cur_parent, iterator::traversal_t::LEAD);
-                auto new_pos = tmp.insert(pos, *it);
-                return new_pos.node_;
-            };
+    void write_header(std::ostream& out, const stream_header_t& header);
+    // throws std::runtime_error for a stream of another format,
+    // version or byte order
+    stream_header_t read_header(std::istream& in);
+}
 
-        // copping
-        // exception safety is based on the fact, that
-        // state chahges only only by insert (this function is exception safe)
-        // after each insert *this is a valid forest (equal to rhs's subforest)
-        for (auto it = rhs.begin(); it != rhs.end(); ++it)
+template<typename CharT, typename Traits, typename Alloc>
+struct codec<std::basic_string<CharT, Traits, Alloc>>
+{
+    static constexpr bool raw = false;
+
+    static void write(std::ostream& out, const std::basic_string<CharT, Traits, Alloc>& value)
+    {
+        detail::write_varint(out, value.size());
+        out.write(reinterpret_cast<const char*>(value.data()), value.size() * sizeof(CharT));
+    }
+
+    // read in pieces, so a corrupt length runs out of stream
+    // before it runs out of memory
+    static std::basic_string<CharT, Traits, Alloc> read(std::istream& in)
+    {
+        constexpr std::uint64_t piece = 4096;
+        auto length = detail::read_varint(in);
+        std::basic_string<CharT, Traits, Alloc> value;
+        while (value.size() < length)
         {
-            auto cur_level = rhs.get_level(it);
-            auto inc_parent_level = cur_parent->level_ + 1;
-            // parent is the same
-            if (cur_level == inc_parent_level)
+            auto size = value.size();
+            auto count = std::min<std::uint64_t>(length - size, piece);
+            value.resize(size + count);
+            in.read(reinterpret_cast<char*>(value.data() + size), count * sizeof(CharT));
+            if (!in)
             {
-                last_inserted = tmp_insert_helper(it, cur_parent);
-            }
-            else
-            {
-                // going deeper
-                if (cur_level > inc_parent_level)
-                {
-                    assert(cur_level - inc_parent_level == 1 &&
-                           "can go deeper only by one level");
-                    cur_parent = last_inserted;
-                    last_inserted = tmp_insert_helper(it, cur_parent);
-                }
-                else
-                {
-                    // rolling back towards header
-                    assert(cur_level < inc_parent_level);
-                    // how much steps towards header we have to make
-                    auto steps = inc_parent_level - cur_level;
-                    assert(steps > 0 && "must be at least 1");
-                    // stepping back
-                    for (decltype(steps) i = 0; i < steps; ++i)
-                    {
-                        cur_parent = detail::get_node(cur_parent->get_tail_pass().next_);
-                    }
-                    last_inserted = tmp_insert_helper(it, cur_parent);
-                }
+                throw std::runtime_error("forest: corrupt stream");
             }
         }
+        return value;
+    }
+};
+
+// see frozenforest.hpp
+template<typename T>
+class frozen_forest;
+
+template<typename T, typename Alloc = std::allocator<T>>
+struct forest
+{
+    using iterator = forest_iterator<T>;
+    using const_iterator = const_forest_iterator<T>;
+    using level_t = detail::node_base_t::level_t;
+    using allocator_type = Alloc;
 
+    forest() : forest(Alloc()) {}
+
+    explicit forest(const Alloc& alloc) : header_(nullptr), size_(0), version_(0), pool_(alloc)
+    {
+        header_ = create_header();
+        make_header(header_);
+        make_leaf(header_);
+    }
+
+    forest(const forest& rhs) :
+        forest(rhs, alloc_traits_t::select_on_container_copy_construction(rhs.get_allocator())) {}
+
+    forest(const forest& rhs, const Alloc& alloc) : forest(alloc)
+    {
+        // for exeption safety
+        forest tmp(alloc);
+        copy_nodes(rhs, tmp);
         swap(tmp, *this);
     }
 
-    forest(forest&& rhs) noexcept : header_(rhs.header_), size_(rhs.size_)
+    forest(forest&& rhs) noexcept :
+        header_(rhs.header_), size_(rhs.size_), version_(rhs.version_), level_epoch_(rhs.level_epoch_),
+        pool_(std::move(rhs.pool_))
     {
         rhs.header_ = nullptr;
         rhs.size_ = 0;
+        ++rhs.version_;
+#if FORESTLIB_INSTRUMENT
+        std::copy(std::begin(rhs.counts_), std::end(rhs.counts_), counts_);
+        std::fill(std::begin(rhs.counts_), std::end(rhs.counts_), 0);
+#endif
+    }
+
+    // steals rhs's nodes if they can be freed by alloc,
+    // moves the values one by one otherwise
+    forest(forest&& rhs, const Alloc& alloc) : forest(alloc)
+    {
+        if (alloc == rhs.get_allocator())
+        {
+            swap(*this, rhs);
+        }
+        else
+        {
+            forest tmp(alloc);
+            copy_nodes(std::move(rhs), tmp);
+            swap(tmp, *this);
+        }
+    }
+
+    // see assign_preorder
+    template<typename InputIt>
+    forest(InputIt first, InputIt last, const Alloc& alloc = Alloc()) : forest(alloc)
+    {
+        assign_preorder(first, last);
     }
 
     forest& operator=(const forest& rhs)
@@ -435,31 +1540,54 @@ struct forest
         {
             return *this;
         }
-        auto tmp = rhs;
-        swap(tmp, *this);
+        if constexpr (alloc_traits_t::propagate_on_container_copy_assignment::value)
+        {
+            forest tmp(rhs, rhs.get_allocator());
+            swap_with_allocators(tmp, *this);
+        }
+        else
+        {
+            forest tmp(rhs, get_allocator());
+            swap(tmp, *this);
+        }
         return *this;
     }
 
-    forest& operator=(forest&& rhs) noexcept
+    forest& operator=(forest&& rhs)
+        noexcept(std::allocator_traits<Alloc>::propagate_on_container_move_assignment::value ||
+                 std::allocator_traits<Alloc>::is_always_equal::value)
     {
         if (this == &rhs)
         {
             return *this;
         }
-        auto tmp = std::move(rhs);
-        swap(tmp, *this);
+        if constexpr (alloc_traits_t::propagate_on_container_move_assignment::value)
+        {
+            auto tmp = std::move(rhs);
+            swap_with_allocators(tmp, *this);
+        }
+        else
+        {
+            forest tmp(std::move(rhs), get_allocator());
+            swap(tmp, *this);
+        }
         return *this;
     }
 
     ~forest() noexcept
     {
         clear();
-        delete header_;
+        destroy_header(header_);
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return pool_.get_allocator();
     }
 
     iterator end() noexcept
     {
-        return iterator(header_, iterator::traversal_t::LEAD);
+        return iterator(header_, iterator::traversal_t::LEAD, 0, level_epoch_);
     }
 
     iterator begin() noexcept
@@ -470,7 +1598,7 @@ struct forest
 
     const_iterator end() const noexcept
     {
-        return const_iterator(header_, iterator::traversal_t::LEAD);
+        return const_iterator(header_, iterator::traversal_t::LEAD, 0, level_epoch_);
     }
 
     const_iterator begin() const noexcept
@@ -482,13 +1610,44 @@ struct forest
     // add for const forest
     post_order<T> get_post_order() noexcept
     {
-        return post_order<T>(header_);
+        return post_order<T>(header_, level_epoch_);
+    }
+
+    // all levels from the roots down, each one in pre-order;
+    // O(1) a step with FORESTLIB_LEVEL_THREADS, without them every level
+    // is found by a walk of the levels above, O(n * depth) in all:
+    // deep forests walked level by level want the threads
+    level_order_view<iterator> get_level_order() noexcept
+    {
+        return level_order_view<iterator>(end(), 1, false);
+    }
+
+    level_order_view<const_iterator> get_level_order() const noexcept
+    {
+        return level_order_view<const_iterator>(end(), 1, false);
+    }
+
+    // nodes of one level (the roots' is 1) in pre-order,
+    // none for level 0 or one below the deepest node;
+    // O(1) a step with FORESTLIB_LEVEL_THREADS, without them a walk
+    // of the levels above, up to O(n) for the level, see get_level_order()
+    level_order_view<iterator> get_level_order(level_t level) noexcept
+    {
+        return level_order_view<iterator>(end(), level, true);
     }
 
+    level_order_view<const_iterator> get_level_order(level_t level) const noexcept
+    {
+        return level_order_view<const_iterator>(end(), level, true);
+    }
+
+    // O(1) for an iterator counted in the current level epoch, the level
+    // of one from an earlier epoch may be stale and is counted up through
+    // the parents, O(level)
     template<typename Iter>
     level_t get_level(const Iter pos) const noexcept
     {
-        return pos.node_->level_;
+        return pos.epoch_ == level_epoch_ ? pos.level_ : detail::level_of(pos.node_);
     }
 
     template<typename Iter>
@@ -497,35 +1656,272 @@ struct forest
         return is_leaf(pos.node_);
     }
 
+    // end() stands for roots
+    children_view<iterator> children(iterator pos) noexcept
+    {
+        return children_view<iterator>(pos);
+    }
+
+    children_view<const_iterator> children(const_iterator pos) const noexcept
+    {
+        return children_view<const_iterator>(pos);
+    }
+
+    // new node becomes the last child of pos
     iterator insert(iterator pos, const T& value)
     {
-        // new node iserts before tail
-        auto& next_pass = pos.node_->get_tail_pass();
-        // new node's pred
-        auto& pred_pass = *next_pass.pred_;
-        // new node's level
-        auto level = get_level(pos) + 1;
+        return emplace_node(pos, value);
+    }
 
-        auto new_node = construct_node(value, level);
+    iterator insert(iterator pos, T&& value)
+    {
+        return emplace_node(pos, std::move(value));
+    }
 
-        // Kalbs line
-        //---------------------------------------------------
+    // value is constructed in place from args
+    template<typename... Args>
+    iterator emplace(iterator pos, Args&&... args)
+    {
+        return emplace_node(pos, std::forward<Args>(args)...);
+    }
 
-        // binding
-        make_leaf(new_node);
-        new_node->get_tail_pass().next_ = &next_pass;
-        new_node->get_lead_pass().pred_ = &pred_pass;
-        next_pass.pred_ = &new_node->get_tail_pass();
-        pred_pass.next_ = &new_node->get_lead_pass();
+    template<typename... Args>
+    iterator emplace_back_child(iterator pos, Args&&... args)
+    {
+        return emplace_node(pos, std::forward<Args>(args)...);
+    }
 
-        return iterator(new_node, pos.traversal_);
+    // new node becomes the first child of pos
+    template<typename... Args>
+    iterator emplace_front_child(iterator pos, Args&&... args)
+    {
+        auto level = get_level(pos) + 1;
+        reserve_level(level);
+        auto new_node = construct_node(std::forward<Args>(args)...);
+        bind_first_child(pos.node_, new_node);
+        thread_level(new_node, level);
+        return iterator(new_node, pos.traversal_, level, level_epoch_);
     }
 
     iterator erase(iterator pos) noexcept
     {
-        auto tmp = pos;
-        wise_delete_node(pos.node_);
-        return ++tmp;
+        // next one is found before pos is freed:
+        // its memory goes back to the pool right away
+        auto next = pos;
+        ++next;
+        bool internal = !is_leaf(pos.node_);
+        // in pre-order next one is the first child if any,
+        // it goes one level up
+        if (pos.traversal_ == iterator::traversal_t::LEAD && internal)
+        {
+            --next.level_;
+        }
+        unthread_level(pos.node_, get_level(pos));
+        delete_node(pos.node_);
+        if (internal)
+        {
+            // levels of the subtree counted so far are stale,
+            // next's one is right if pos's was
+            bool current = next.epoch_ == level_epoch_;
+            ++level_epoch_;
+            if (current)
+            {
+                next.epoch_ = level_epoch_;
+            }
+        }
+        return next;
+    }
+
+    // replaces the nodes with (level, value) pairs given in pre-order:
+    // the first level is 1, every next one is at most one deeper
+    // values are moved from rvalue pairs (move_iterator)
+    // throws std::invalid_argument for other levels, the forest is left as it was
+    template<typename InputIt>
+    void assign_preorder(InputIt first, InputIt last)
+    {
+        // nodes come from the pool chunk by chunk, one block
+        // for all of them costs more in fresh pages than it saves
+        forest tmp(get_allocator());
+        // the last node on every level: parents are not
+        // looked for through the nodes, it is far cheaper
+        std::vector<node_base_t*> path(1, tmp.header_);
+        for (; first != last; ++first)
+        {
+            auto&& elem = *first;
+            level_t level = std::get<0>(elem);
+            if (level == 0 || level > path.size())
+            {
+                throw std::invalid_argument("forest: levels are not a pre-order");
+            }
+            tmp.append_preorder(path, level, std::get<1>(std::forward<decltype(elem)>(elem)));
+        }
+        swap(tmp, *this);
+    }
+
+    // the same, parents are found on several threads first
+    // pays off for big inputs only
+    template<typename RandomIt>
+    void assign_preorder_parallel(RandomIt first, RandomIt last,
+                                  unsigned threads = std::thread::hardware_concurrency())
+    {
+        std::size_t size = last - first;
+        std::vector<level_t> levels(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            levels[i] = std::get<0>(first[i]);
+        }
+        auto parents = detail::preorder_parents(levels.data(), size, std::max(threads, 1u));
+
+        forest tmp(get_allocator());
+        std::vector<node_base_t*> nodes(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            auto&& elem = first[i];
+            tmp.reserve_level(levels[i]);
+            nodes[i] = tmp.construct_node(std::get<1>(std::forward<decltype(elem)>(elem)));
+            bind_last_child(parents[i] == size ? tmp.header_ : nodes[parents[i]], nodes[i]);
+            tmp.thread_level(nodes[i], levels[i]);
+        }
+        swap(tmp, *this);
+    }
+
+    // binary format, version 1:
+    //   header (see detail::write_header)
+    //   chunks of chunk_size nodes in pre-order (the last one may be shorter):
+    //     varint byte length of the levels
+    //     varint per node: previous level + 1 - level
+    //     values: raw bytes in one column or codec<T>::write one by one
+    // raw values and the header are in the byte order of the machine
+    void save(std::ostream& out) const
+    {
+        using codec_t = codec<T>;
+        constexpr std::size_t chunk_size = 4096;
+
+        detail::write_header(out, {codec_t::raw, codec_t::raw ? sizeof(T) : 0, size_, chunk_size});
+        std::vector<char> levels;
+        levels.reserve(2 * chunk_size);
+        std::vector<raw_value_t> column(codec_t::raw ? chunk_size : 0);
+        level_t last_level = 0;
+        for (auto it = begin(); it != end();)
+        {
+            auto chunk_first = it;
+            std::size_t count = 0;
+            levels.clear();
+            for (; it != end() && count < chunk_size; ++it, ++count)
+            {
+                auto level = get_level(it);
+                detail::put_varint(levels, last_level + 1 - level);
+                last_level = level;
+                if constexpr (codec_t::raw)
+                {
+                    std::memcpy(&column[count], std::addressof(*it), sizeof(T));
+                }
+            }
+
+            detail::write_varint(out, levels.size());
+            out.write(levels.data(), levels.size());
+            if constexpr (codec_t::raw)
+            {
+                out.write(reinterpret_cast<const char*>(column.data()), count * sizeof(T));
+            }
+            else
+            {
+                for (auto value = chunk_first; value != it; ++value)
+                {
+                    codec_t::write(out, *value);
+                }
+            }
+        }
+        if (!out)
+        {
+            throw std::runtime_error("forest: write failed");
+        }
+    }
+
+    // replaces the nodes with the ones saved by save,
+    // chunk by chunk straight into the pre-order build
+    // throws std::runtime_error for a broken or foreign stream,
+    // the forest is left as it was
+    void load(std::istream& in)
+    {
+        using codec_t = codec<T>;
+        constexpr std::size_t max_chunk_size = 1 << 20;
+
+        auto header = detail::read_header(in);
+        if (header.raw_ != codec_t::raw || header.value_size_ != (codec_t::raw ? sizeof(T) : 0))
+        {
+            throw std::runtime_error("forest: stream holds values of another type");
+        }
+        if (header.chunk_size_ == 0 || header.chunk_size_ > max_chunk_size)
+        {
+            throw std::runtime_error("forest: corrupt stream");
+        }
+
+        forest tmp(get_allocator());
+        std::vector<node_base_t*> path(1, tmp.header_);
+        std::vector<char> levels;
+        std::vector<level_t> chunk_levels(header.chunk_size_);
+        std::vector<raw_value_t> column(codec_t::raw ? header.chunk_size_ : 0);
+        level_t last_level = 0;
+        for (auto left = header.size_; left > 0;)
+        {
+            auto count = static_cast<std::size_t>(std::min<std::uint64_t>(left, header.chunk_size_));
+            // a level takes 5 bytes at most
+            auto length = detail::read_varint(in);
+            if (length > 5 * count)
+            {
+                throw std::runtime_error("forest: corrupt stream");
+            }
+            levels.resize(length);
+            in.read(levels.data(), length);
+
+            const char* pos = levels.data();
+            const char* levels_end = pos + (in ? length : 0);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                auto up = detail::get_varint(pos, levels_end);
+                if (up > last_level)
+                {
+                    throw std::runtime_error("forest: corrupt stream");
+                }
+                last_level = last_level + 1 - static_cast<level_t>(up);
+                chunk_levels[i] = last_level;
+            }
+
+            if constexpr (codec_t::raw)
+            {
+                in.read(reinterpret_cast<char*>(column.data()), count * sizeof(T));
+                if (!in)
+                {
+                    throw std::runtime_error("forest: corrupt stream");
+                }
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    tmp.append_preorder(path, chunk_levels[i],
+                                        *std::launder(reinterpret_cast<const T*>(&column[i])));
+                }
+            }
+            else
+            {
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    tmp.append_preorder(path, chunk_levels[i], codec_t::read(in));
+                }
+                if (!in)
+                {
+                    throw std::runtime_error("forest: corrupt stream");
+                }
+            }
+            left -= count;
+        }
+        swap(tmp, *this);
+    }
+
+    // immutable structure-of-arrays copy,
+    // needs frozenforest.hpp
+    frozen_forest<T> freeze() const
+    {
+        return frozen_forest<T>(*this);
     }
 
     size_t size() const noexcept
@@ -538,62 +1934,383 @@ struct forest
         return size_ == 0;
     }
 
+    // changes with every insert, erase, clear, swap and assignment,
+    // values may change under the same version
+    std::uint64_t version() const noexcept
+    {
+        return version_;
+    }
+
+    // see forest_counters
+    forest_counters counters() const noexcept
+    {
+#if FORESTLIB_INSTRUMENT
+        return detail::make_counters(counts_);
+#else
+        return forest_counters();
+#endif
+    }
+
+    // nobody looks at the links of dying nodes,
+    // so nothing is relinked: values are destroyed in one
+    // post-order sweep (skipped for trivially destructible T)
+    // and the pool gives its chunks back at once
     void clear() noexcept
     {
-        while(!empty())
+        if (empty())
         {
-            auto node = begin().node_;
-            dumb_delete_node(node);
+            return;
+        }
+
+        if constexpr (!std::is_trivially_destructible_v<T> ||
+                      !detail::node_pool<node_t, Alloc>::releases_in_bulk)
+        {
+            auto node = detail::traverse(header_, pass_base_t::type_t::TAIL,
+                                         pass_base_t::direction_t::NEXT);
+            while (node != header_)
+            {
+                // successor is found while node is still alive
+                auto next = detail::traverse(node, pass_base_t::type_t::TAIL,
+                                             pass_base_t::direction_t::NEXT);
+                destroy_node(static_cast<node_t*>(node));
+                if constexpr (!detail::node_pool<node_t, Alloc>::releases_in_bulk)
+                {
+                    pool_.deallocate(static_cast<node_t*>(node));
+                }
+                node = next;
+            }
         }
+        pool_.release();
+#if FORESTLIB_INSTRUMENT
+        count(detail::NODES_FREED, size_);
+        uncount(detail::BYTES_IN_USE, size_ * sizeof(node_t));
+#endif
+
+        make_header(header_);
+        make_leaf(header_);
+#if FORESTLIB_LEVEL_THREADS
+        header_->levels_.clear();
+#endif
+        size_ = 0;
+        ++version_;
     }
 
+    // allocators are swapped only if they propagate on swap,
+    // otherwise they must be equal
     friend void swap(forest& lhs, forest& rhs) noexcept
     {
-        std::swap(lhs.size_, rhs.size_);
-        std::swap(lhs.header_, rhs.header_);
+        if constexpr (alloc_traits_t::propagate_on_container_swap::value)
+        {
+            swap_with_allocators(lhs, rhs);
+        }
+        else
+        {
+            assert(lhs.get_allocator() == rhs.get_allocator() &&
+                   "swapping forests with unequal allocators");
+            std::swap(lhs.size_, rhs.size_);
+            std::swap(lhs.header_, rhs.header_);
+            std::swap(lhs.level_epoch_, rhs.level_epoch_);
+            swap_storage(lhs.pool_, rhs.pool_);
+#if FORESTLIB_INSTRUMENT
+            std::swap(lhs.counts_, rhs.counts_);
+#endif
+            bump_versions(lhs, rhs);
+        }
     }
 
     private:
+        // thaws through copy_nodes
+        friend class frozen_forest<T>;
+
         using pass_base_t = detail::pass_base_t;
         using node_base_t = detail::node_base_t;
         using node_t = detail::node_t<T>;
         using header_t = detail::header_t;
+        using alloc_traits_t = std::allocator_traits<Alloc>;
+        using header_alloc_t = typename alloc_traits_t::template rebind_alloc<header_t>;
+        using header_traits_t = std::allocator_traits<header_alloc_t>;
+        // storage for a raw value in save/load columns
+        using raw_value_t = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+        static void swap_with_allocators(forest& lhs, forest& rhs) noexcept
+        {
+            std::swap(lhs.size_, rhs.size_);
+            std::swap(lhs.header_, rhs.header_);
+            std::swap(lhs.level_epoch_, rhs.level_epoch_);
+            swap(lhs.pool_, rhs.pool_);
+#if FORESTLIB_INSTRUMENT
+            std::swap(lhs.counts_, rhs.counts_);
+#endif
+            bump_versions(lhs, rhs);
+        }
+
+        // both get a version neither had, whatever was built
+        // for one of them is stale now
+        static void bump_versions(forest& lhs, forest& rhs) noexcept
+        {
+            lhs.version_ = rhs.version_ = std::max(lhs.version_, rhs.version_) + 1;
+        }
+
+        // appends src's nodes to empty dst
+        // values are moved if src is an rvalue
+        // all the nodes are taken from one block, every one is linked
+        // right after its parent and previous sibling, so it is a single
+        // linear sweep over src
+        // exception safety is based on the fact, that
+        // after each append dst is a valid forest (equal to src's subforest)
+        template<typename Src>
+        static void copy_nodes(Src&& src, forest& dst)
+        {
+            using value_ref_t = std::conditional_t<std::is_lvalue_reference_v<Src>, const T&, T&&>;
+
+            dst.pool_.reserve(src.size());
+#if FORESTLIB_INSTRUMENT
+            dst.count(detail::COPIES);
+            dst.count(detail::COPIED_NODES, src.size());
+#endif
+            node_base_t* last_appended = dst.header_;
+            level_t last_level = 0;
+            for (auto it = src.begin(); it != src.end(); ++it)
+            {
+                auto level = src.get_level(it);
+                last_appended = dst.append_node(last_appended, last_level, level,
+                                                static_cast<value_ref_t>(*it));
+                last_level = level;
+            }
+        }
+
+        // appends new node to the end of pre-order
+        // path holds the last node on every level from the header on,
+        // level is the new node's one: from 1 to path.size()
+        template<typename... Args>
+        void append_preorder(std::vector<node_base_t*>& path, level_t level, Args&&... args)
+        {
+            assert(level > 0 && level <= path.size() && "wrong level");
+            path.resize(level);
+            reserve_level(level);
+            auto new_node = construct_node(std::forward<Args>(args)...);
+            bind_last_child(path.back(), new_node);
+            thread_level(new_node, level);
+            path.push_back(new_node);
+        }
+
+        // appends new node to the end of pre-order
+        // last is the last node in pre-order (header_ for empty forest)
+        // level is the new node's one: from 1 to last_level + 1
+        template<typename... Args>
+        node_base_t* append_node(node_base_t* last, level_t last_level, level_t level,
+                                 Args&&... args)
+        {
+            assert(level > 0 && level <= last_level + 1 && "wrong level");
+            auto parent = last;
+            for (auto steps = last_level + 1 - level; steps > 0; --steps)
+            {
+                parent = parent->parent_;
+            }
+
+            reserve_level(level);
+            auto new_node = construct_node(std::forward<Args>(args)...);
+            bind_last_child(parent, new_node);
+            thread_level(new_node, level);
+            return new_node;
+        }
+
+        // inserts the new node as the last child of pos
+        template<typename... Args>
+        iterator emplace_node(iterator pos, Args&&... args)
+        {
+            auto level = get_level(pos) + 1;
+            reserve_level(level);
+            auto new_node = construct_node(std::forward<Args>(args)...);
+
+            // Kalbs line
+            //---------------------------------------------------
+
+            bind_last_child(pos.node_, new_node);
+            thread_level(new_node, level);
+            return iterator(new_node, pos.traversal_, level, level_epoch_);
+        }
+
+        // level threads upkeep, nothing is done without them
+        // room for a node on level is made before the node,
+        // so threading it can not fail;
+        // levels come from get_level, right for stale iterators too
+        void reserve_level(level_t level)
+        {
+#if FORESTLIB_LEVEL_THREADS
+            if (header_->levels_.size() < level)
+            {
+                header_->levels_.resize(level);
+            }
+#else
+            (void)level;
+#endif
+        }
+
+        void thread_level(node_base_t* leaf, level_t level) noexcept
+        {
+#if FORESTLIB_LEVEL_THREADS
+            detail::thread_level(leaf, header_->levels_[level - 1]);
+#else
+            (void)leaf;
+            (void)level;
+#endif
+        }
+
+        // before node's passes are unlinked
+        void unthread_level(node_base_t* node, level_t level) noexcept
+        {
+#if FORESTLIB_LEVEL_THREADS
+            auto& levels = header_->levels_;
+            if (is_leaf(node))
+            {
+                detail::unthread_level_leaf(node, levels[level - 1]);
+            }
+            else
+            {
+                auto looked_through = detail::unthread_level_internal(node, &levels[level - 1]);
+#if FORESTLIB_INSTRUMENT
+                count(detail::ERASE_WALK, looked_through);
+#else
+                (void)looked_through;
+#endif
+            }
+            while (!levels.empty() && !levels.back().head_)
+            {
+                levels.pop_back();
+            }
+#else
+            (void)node;
+            (void)level;
+#endif
+        }
+
+        // new leaf becomes the last child of parent
+        static void bind_last_child(node_base_t* parent, node_base_t* leaf) noexcept
+        {
+            // new node iserts before tail
+            auto next_link = parent->get_tail_link();
+            bind_leaf(parent, leaf, next_link->pred_, next_link);
+        }
+
+        // new leaf becomes the first child of parent
+        static void bind_first_child(node_base_t* parent, node_base_t* leaf) noexcept
+        {
+            // new node iserts after lead
+            auto pred_link = parent->get_lead_link();
+            bind_leaf(parent, leaf, pred_link, pred_link->next_);
+        }
+
+        // leaf goes between two adjacent passes of parent's children
+        static void bind_leaf(node_base_t* parent, node_base_t* leaf,
+                              pass_base_t::link_t pred_link, pass_base_t::link_t next_link) noexcept
+        {
+            // binding
+            make_leaf(leaf);
+            leaf->parent_ = parent;
+            leaf->get_tail_pass().next_ = next_link;
+            leaf->get_lead_pass().pred_ = pred_link;
+            next_link->pred_ = leaf->get_tail_link();
+            pred_link->next_ = leaf->get_lead_link();
+#if FORESTLIB_ORDER_THREADS
+            detail::thread_leaf(leaf);
+#endif
+        }
+
+        header_t* create_header()
+        {
+            header_alloc_t alloc(get_allocator());
+            auto header = header_traits_t::allocate(alloc, 1);
+            return ::new (static_cast<void*>(header)) header_t;
+        }
+
+        void destroy_header(header_t* header) noexcept
+        {
+            if (header)
+            {
+                header_alloc_t alloc(get_allocator());
+                header->~header_t();
+                header_traits_t::deallocate(alloc, header, 1);
+            }
+        }
 
         // binds next_[pass_type_t::LEADING]
         // and pred_[pass_type_t::TRAILING]
         static void make_leaf(node_base_t* node) noexcept
         {
-            node->get_lead_pass().next_ = &node->get_tail_pass();
-            node->get_tail_pass().pred_ = &node->get_lead_pass();
+            node->get_lead_pass().next_ = node->get_tail_link();
+            node->get_tail_pass().pred_ = node->get_lead_link();
         }
 
         // binds next_[pass_type_t::LEADING]
         // and pred_[pass_type_t::TRAILING]
         static void make_header(node_base_t* node) noexcept
         {
-            node->get_tail_pass().next_ = &node->get_lead_pass();
-            node->get_lead_pass().pred_ = &node->get_tail_pass();
+            node->get_tail_pass().next_ = node->get_lead_link();
+            node->get_lead_pass().pred_ = node->get_tail_link();
+#if FORESTLIB_ORDER_THREADS
+            for (auto order : {pass_base_t::type_t::LEAD, pass_base_t::type_t::TAIL})
+            {
+                node->order_next_[order] = node;
+                node->order_pred_[order] = node;
+                node->order_shift_[order] = 0;
+            }
+#endif
         }
 
         bool is_leaf(node_base_t* node) const noexcept
         {
-            bool res = node->get_lead_pass().next_ == &node->get_tail_pass();
+            bool res = node->get_lead_pass().next_ == node->get_tail_link();
             // check if node is consistent
-            assert(res == (node->get_tail_pass().pred_ == &node->get_lead_pass()));
+            assert(res == (node->get_tail_pass().pred_ == node->get_lead_link()));
             return res;
         }
 
-        node_t* construct_node(const T& value, level_t level)
+        // payload goes through the allocator
+        // so std::pmr allocators reach it too
+        template<typename... Args>
+        node_t* construct_node(Args&&... args)
         {
-            auto new_node = new node_t (value, level);
+            auto new_node = ::new (static_cast<void*>(pool_.allocate())) node_t;
+            try
+            {
+                auto alloc = get_allocator();
+                alloc_traits_t::construct(alloc, std::addressof(new_node->data_),
+                                          std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                new_node->~node_t();
+                pool_.deallocate(new_node);
+                throw;
+            }
             ++size_;
+            ++version_;
+#if FORESTLIB_INSTRUMENT
+            count(detail::NODES_ALLOCATED);
+            count(detail::BYTES_IN_USE, sizeof(node_t));
+#endif
             return new_node;
         }
 
         void destruct_node(node_t* node) noexcept
         {
-            delete node;
+            destroy_node(node);
+            pool_.deallocate(node);
             --size_;
+            ++version_;
+#if FORESTLIB_INSTRUMENT
+            count(detail::NODES_FREED);
+            uncount(detail::BYTES_IN_USE, sizeof(node_t));
+#endif
+        }
+
+        // storage is left as it is
+        void destroy_node(node_t* node) noexcept
+        {
+            auto alloc = get_allocator();
+            alloc_traits_t::destroy(alloc, std::addressof(node->data_));
+            node->~node_t();
         }
 
         void delete_leaf(node_base_t* leaf) noexcept
@@ -601,24 +2318,45 @@ struct forest
             assert(detail::get_node(leaf->get_lead_pass().next_) == leaf &&
                 detail::get_node(leaf->get_tail_pass().pred_) == leaf &&
                 "wrong argument: must be a leaf");
-            pass_base_t& pred_pass = *leaf->get_lead_pass().pred_;
-            pass_base_t& next_pass = *leaf->get_tail_pass().next_;
+#if FORESTLIB_ORDER_THREADS
+            detail::unthread_leaf(leaf);
+#endif
+            auto pred_link = leaf->get_lead_pass().pred_;
+            auto next_link = leaf->get_tail_pass().next_;
 
             // binding
-            pred_pass.next_ = &next_pass;
-            next_pass.pred_ = &pred_pass;
+            pred_link->next_ = next_link;
+            next_link->pred_ = pred_link;
 
             destruct_node(static_cast<node_t*>(leaf));
         }
 
-        // corrects nothing after deletion (level etc.)
-        // except size
-        void dumb_delete_internal(node_base_t* node) noexcept
+        // children take node's place, their subtrees stay
+        // as they are: levels are not stored, only children's
+        // parent is updated, so it is O(children)
+        void delete_internal(node_base_t* node) noexcept
         {
             assert(detail::get_node(node->get_lead_pass().next_) != node &&
                 detail::get_node(node->get_tail_pass().pred_) != node &&
                 "wrong argument: must be an internal node");
 
+            std::uint64_t children = 0;
+            for (auto child = detail::first_child(node); child;
+                 child = detail::next_sibling(child))
+            {
+                child->parent_ = node->parent_;
+                ++children;
+            }
+#if FORESTLIB_INSTRUMENT
+            count(detail::INTERNAL_ERASES);
+            count(detail::ERASE_WALK, children);
+#else
+            (void)children;
+#endif
+#if FORESTLIB_ORDER_THREADS
+            detail::unthread_internal(node);
+#endif
+
             // rebinding
             // [pred_pass]--X-->[node->pass]--X-->[next_pass]
             //           \                          ^
@@ -634,23 +2372,7 @@ struct forest
             destruct_node(static_cast<node_t*>(node));
         }
 
-        // at least meant to be so
-        void wise_delete_internal(node_base_t* node) noexcept
-        {
-            // traversing subtree of node to delete
-            for (auto it = ++iterator(node, iterator::traversal_t::LEAD);
-                 get_level(it) > node->level_;
-                 ++it)
-            {
-                --(it.node_->level_);
-            }
-            // now can delete this sucker
-            dumb_delete_internal(node);
-        }
-
-        // corrects nothing after deletion (level etc.)
-        // except size
-        void dumb_delete_node(node_base_t* node) noexcept
+        void delete_node(node_base_t* node) noexcept
         {
             if (is_leaf(node))
             {
@@ -658,28 +2380,39 @@ struct forest
             }
             else
             {
-                dumb_delete_internal(node);
+                delete_internal(node);
             }
         }
 
-        void wise_delete_node(node_base_t* node) noexcept
+#if FORESTLIB_INSTRUMENT
+        // an event for the forest's counters and the global ones
+        void count(detail::counter_t counter, std::uint64_t by = 1) noexcept
         {
-            if (is_leaf(node))
-            {
-                delete_leaf(node);
-            }
-            else
-            {
-                wise_delete_internal(node);
-            }
+            counts_[counter] += by;
+            detail::count_globally(counter, by);
         }
 
+        void uncount(detail::counter_t counter, std::uint64_t by) noexcept
+        {
+            counts_[counter] -= by;
+            detail::uncount_globally(counter, by);
+        }
+#endif
+
         header_t* header_;
         size_t size_;
+        std::uint64_t version_;
+        // bumped by erases of internal nodes, see forest_iterator;
+        // travels with the nodes on swap and move
+        std::uint64_t level_epoch_ = 0;
+        detail::node_pool<node_t, Alloc> pool_;
+#if FORESTLIB_INSTRUMENT
+        std::uint64_t counts_[detail::COUNTERS] = {};
+#endif
 };
 
-template<typename T>
-bool operator==(const forest<T>& lhs, const forest<T>& rhs) noexcept
+template<typename T, typename Alloc>
+bool operator==(const forest<T, Alloc>& lhs, const forest<T, Alloc>& rhs) noexcept
 {
     if (lhs.size() != rhs.size())
     {
@@ -689,11 +2422,76 @@ bool operator==(const forest<T>& lhs, const forest<T>& rhs) noexcept
     return std::equal(lhs.begin(), lhs.end(), rhs.begin());
 }
 
-template<typename T>
-bool operator!=(const forest<T>& lhs, const forest<T>& rhs) noexcept
+template<typename T, typename Alloc>
+bool operator!=(const forest<T, Alloc>& lhs, const forest<T, Alloc>& rhs) noexcept
 {
     return !(lhs == rhs);
 }
 
+namespace detail
+{
+    // the passes from the one after end's to end's tail,
+    // see forestlib::euler_walk
+    template<typename Iter, typename Enter, typename Exit>
+    void walk_passes(Iter end, Enter& on_enter, Exit& on_exit)
+    {
+        using type_t = pass_base_t::type_t;
+
+        typename Iter::level_t level = 0;
+        auto pass = end.node_->get_lead_pass().next_;
+        for (auto node = get_node(pass); node != end.node_; node = get_node(pass))
+        {
+            if (pass.type() == type_t::LEAD)
+            {
+                Iter pos(node, type_t::LEAD, ++level, end.epoch_);
+                if constexpr (std::is_same_v<std::invoke_result_t<Enter&, Iter>, bool>)
+                {
+                    if (!on_enter(pos))
+                    {
+                        pass = node->get_tail_link();
+                        continue;
+                    }
+                }
+                else
+                {
+                    on_enter(pos);
+                }
+            }
+            else
+            {
+                on_exit(Iter(node, type_t::LEAD, level--, end.epoch_));
+            }
+            pass = pass->next_;
+        }
+    }
+}
+
+// enter and exit events of every node in one walk over the passes,
+// half of what a pre-order walk and a post-order one take:
+// on_enter(pos) comes at the node's lead pass, on_exit(pos) at its tail
+// pass, pos is a pre-order iterator with the node's level;
+// if on_enter returns bool, false skips the node's subtree
+// (on_exit still comes for the node itself)
+// the forest must not change meanwhile
+template<typename T, typename Alloc, typename Enter, typename Exit>
+void euler_walk(forest<T, Alloc>& any_forest, Enter&& on_enter, Exit&& on_exit)
+{
+    detail::walk_passes(any_forest.end(), on_enter, on_exit);
+}
+
+template<typename T, typename Alloc, typename Enter, typename Exit>
+void euler_walk(const forest<T, Alloc>& any_forest, Enter&& on_enter, Exit&& on_exit)
+{
+    detail::walk_passes(any_forest.end(), on_enter, on_exit);
+}
+
+namespace pmr
+{
+
+template<typename T>
+using forest = forestlib::forest<T, std::pmr::polymorphic_allocator<T>>;
+
+} //pmr
+
 } //forest
 #endif //TREE_LIB
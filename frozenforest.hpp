@@ -0,0 +1,264 @@
+#ifndef FROZEN_TREE_LIB
+#define FROZEN_TREE_LIB
+
+#include <cassert>
+#include <iterator>
+#include <vector>
+
+#include "forest.hpp"
+
+namespace forestlib
+{
+
+// pre-order index of a node is its position in every array:
+// subtree of node i is [i, i + subtree_size(i)),
+// parent of a root is size(), i.e. end()
+template<typename T>
+class frozen_forest;
+
+template<typename T>
+struct frozen_iterator
+{
+    using difference_type = ptrdiff_t;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using pointer = const T*;
+    using reference = const T&;
+
+    using traversal_t = detail::pass_base_t::type_t;
+    using level_t = detail::node_base_t::level_t;
+
+    // pos is the position in the traversal order,
+    // size() stands for the end in both orders
+    frozen_iterator(const frozen_forest<T>* forest, traversal_t traversal, size_t pos) noexcept :
+        forest_(forest), traversal_(traversal), pos_(pos) {}
+
+    reference operator*() const noexcept
+    {
+        return forest_->values_[index()];
+    }
+
+    pointer operator->() const noexcept
+    {
+        return &forest_->values_[index()];
+    }
+
+    frozen_iterator& operator++() noexcept
+    {
+        ++pos_;
+        return *this;
+    }
+
+    frozen_iterator operator++(int) noexcept
+    {
+        auto tmp = *this;
+        ++(*this);
+        return tmp;
+    }
+
+    frozen_iterator& operator--() noexcept
+    {
+        --pos_;
+        return *this;
+    }
+
+    frozen_iterator operator--(int) noexcept
+    {
+        auto tmp = *this;
+        --(*this);
+        return tmp;
+    }
+
+    // pre-order index of the node
+    size_t index() const noexcept
+    {
+        if (traversal_ == traversal_t::LEAD || pos_ == forest_->size())
+        {
+            return pos_;
+        }
+        return forest_->post_[pos_];
+    }
+
+    friend bool operator==(const frozen_iterator& lhs, const frozen_iterator& rhs) noexcept
+    {
+        return lhs.pos_ == rhs.pos_ &&
+               lhs.traversal_ == rhs.traversal_;
+    }
+
+    friend bool operator!=(const frozen_iterator& lhs, const frozen_iterator& rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+    const frozen_forest<T>* forest_;
+    traversal_t traversal_;
+    size_t pos_;
+};
+
+template<typename T>
+struct frozen_post_order
+{
+    using iterator = frozen_iterator<T>;
+
+    frozen_post_order(const frozen_forest<T>* forest) noexcept :
+        forest_(forest) {}
+
+    iterator begin() const noexcept
+    {
+        return iterator(forest_, iterator::traversal_t::TAIL, 0);
+    }
+
+    iterator end() const noexcept
+    {
+        return iterator(forest_, iterator::traversal_t::TAIL, forest_->size());
+    }
+
+    private:
+        const frozen_forest<T>* forest_;
+};
+
+// immutable snapshot of a forest kept as arrays in pre-order,
+// so walking it is a linear scan with no pointer chasing
+template<typename T>
+class frozen_forest
+{
+    public:
+        using iterator = frozen_iterator<T>;
+        using const_iterator = frozen_iterator<T>;
+        using level_t = detail::node_base_t::level_t;
+
+        frozen_forest() = default;
+
+        // anything with pre-order begin/end, get_level and size
+        template<typename Forest>
+        explicit frozen_forest(const Forest& src)
+        {
+            auto n = src.size();
+            values_.reserve(n);
+            levels_.reserve(n);
+            parents_.reserve(n);
+
+            // the last node seen on every level
+            std::vector<size_t> path;
+            for (auto it = src.begin(); it != src.end(); ++it)
+            {
+                auto level = src.get_level(it);
+                path.resize(level);
+                path[level - 1] = values_.size();
+                parents_.push_back(level > 1 ? path[level - 2] : n);
+                levels_.push_back(level);
+                values_.push_back(*it);
+            }
+
+            // children come after parents
+            sizes_.assign(n, 1);
+            for (size_t i = n; i > 0; --i)
+            {
+                if (parents_[i - 1] != n)
+                {
+                    sizes_[parents_[i - 1]] += sizes_[i - 1];
+                }
+            }
+
+            // node is preceded in post-order by the ones before it
+            // in pre-order except its ancestors, and by its descendants
+            post_.resize(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                post_[i - (levels_[i] - 1) + sizes_[i] - 1] = i;
+            }
+        }
+
+        iterator begin() const noexcept
+        {
+            return iterator(this, iterator::traversal_t::LEAD, 0);
+        }
+
+        iterator end() const noexcept
+        {
+            return iterator(this, iterator::traversal_t::LEAD, size());
+        }
+
+        frozen_post_order<T> get_post_order() const noexcept
+        {
+            return frozen_post_order<T>(this);
+        }
+
+        level_t get_level(const iterator pos) const noexcept
+        {
+            return levels_[pos.index()];
+        }
+
+        bool is_leaf(const iterator pos) const noexcept
+        {
+            return sizes_[pos.index()] == 1;
+        }
+
+        // number of nodes in pos's subtree, pos included
+        size_t subtree_size(const iterator pos) const noexcept
+        {
+            return sizes_[pos.index()];
+        }
+
+        // pre-order iterator past pos's subtree
+        iterator skip_subtree(const iterator pos) const noexcept
+        {
+            auto index = pos.index();
+            return iterator(this, iterator::traversal_t::LEAD, index + sizes_[index]);
+        }
+
+        // pre-order iterator, end() for roots
+        iterator parent(const iterator pos) const noexcept
+        {
+            return iterator(this, iterator::traversal_t::LEAD, parents_[pos.index()]);
+        }
+
+        size_t size() const noexcept
+        {
+            return values_.size();
+        }
+
+        bool empty() const noexcept
+        {
+            return values_.empty();
+        }
+
+        // mutable copy, nodes are linked in one sweep
+        template<typename Alloc = std::allocator<T>>
+        forest<T, Alloc> thaw(const Alloc& alloc = Alloc()) const
+        {
+            forest<T, Alloc> res(alloc);
+            forest<T, Alloc>::copy_nodes(*this, res);
+            return res;
+        }
+
+    private:
+        friend struct frozen_iterator<T>;
+
+        std::vector<T> values_;
+        std::vector<level_t> levels_;
+        std::vector<size_t> sizes_;
+        std::vector<size_t> parents_;
+        // post-order position -> pre-order index
+        std::vector<size_t> post_;
+};
+
+template<typename T>
+bool operator==(const frozen_forest<T>& lhs, const frozen_forest<T>& rhs) noexcept
+{
+    if (lhs.size() != rhs.size())
+    {
+        return false;
+    }
+
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template<typename T>
+bool operator!=(const frozen_forest<T>& lhs, const frozen_forest<T>& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+} //forest
+#endif //FROZEN_TREE_LIB
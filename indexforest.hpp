@@ -0,0 +1,469 @@
+#ifndef INDEX_TREE_LIB
+#define INDEX_TREE_LIB
+
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "forest.hpp"
+
+namespace forestlib
+{
+
+namespace detail
+{
+    // pass as (node index << 1) | pass type, node 0 is the header,
+    // so the links mean the same wherever the nodes are
+    using index_link_t = std::uint32_t;
+
+    // the same passes as node_base_t's, in half the space
+    struct index_node_t
+    {
+        index_link_t next_[2];
+        index_link_t pred_[2];
+        std::uint32_t parent_;
+    };
+
+    // header and every node must fit a link
+    constexpr std::size_t max_index_size = std::numeric_limits<index_link_t>::max() >> 1;
+
+    constexpr index_link_t index_link(std::uint32_t node, pass_base_t::type_t type) noexcept
+    {
+        return (node << 1) | type;
+    }
+
+    // the same as walk, but over the nodes of an index forest
+    std::uint32_t index_walk(const index_node_t* nodes, std::uint32_t node,
+                             pass_base_t::type_t traversal,
+                             pass_base_t::direction_t dir,
+                             node_base_t::level_t& level) noexcept;
+
+    // what an image starts with, the nodes come right after it
+    // and the values at values_offset_
+    struct index_image_header_t
+    {
+        char magic_[8];
+        std::uint32_t version_;
+        // tells the byte order
+        std::uint32_t probe_;
+        std::uint32_t value_size_;
+        std::uint32_t value_align_;
+        std::uint64_t size_;
+        std::uint64_t values_offset_;
+    };
+
+    index_image_header_t make_index_image_header(std::size_t size, std::size_t value_size,
+                                                 std::size_t value_align) noexcept;
+
+    // throws std::runtime_error if data of length bytes is not an image
+    // of forest with values of this size and alignment
+    const index_image_header_t& check_index_image(const char* data, std::size_t length,
+                                                  std::size_t value_size, std::size_t value_align);
+
+    // whole file mapped read-only
+    class mapped_file
+    {
+        public:
+            // throws std::system_error if the file can not be opened or mapped
+            explicit mapped_file(const char* path);
+
+            mapped_file(mapped_file&& rhs) noexcept;
+            mapped_file& operator=(mapped_file&& rhs) noexcept;
+            ~mapped_file();
+
+            const char* data() const noexcept
+            {
+                return data_;
+            }
+
+            std::size_t size() const noexcept
+            {
+                return size_;
+            }
+
+        private:
+            const char* data_;
+            std::size_t size_;
+    };
+}
+
+// Owner is index_forest or mapped_forest,
+// iterators stay valid while the owner grows
+template<typename Owner>
+struct index_iterator
+{
+    using difference_type = ptrdiff_t;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename Owner::value_type;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    using direction_t = detail::pass_base_t::direction_t;
+    using traversal_t = detail::pass_base_t::type_t;
+    using level_t = detail::node_base_t::level_t;
+
+    index_iterator(const Owner* owner, std::uint32_t node, traversal_t traversal, level_t level) noexcept :
+        owner_(owner), node_(node), traversal_(traversal), level_(level) {}
+
+    reference operator*() const noexcept
+    {
+        return owner_->values()[node_ - 1];
+    }
+
+    pointer operator->() const noexcept
+    {
+        return &owner_->values()[node_ - 1];
+    }
+
+    index_iterator& operator++() noexcept
+    {
+        node_ = detail::index_walk(owner_->nodes(), node_, traversal_, direction_t::NEXT, level_);
+        return *this;
+    }
+
+    index_iterator operator++(int) noexcept
+    {
+        auto tmp = *this;
+        ++(*this);
+        return tmp;
+    }
+
+    index_iterator& operator--() noexcept
+    {
+        node_ = detail::index_walk(owner_->nodes(), node_, traversal_, direction_t::PRED, level_);
+        return *this;
+    }
+
+    index_iterator operator--(int) noexcept
+    {
+        auto tmp = *this;
+        --(*this);
+        return tmp;
+    }
+
+    friend bool operator==(const index_iterator& lhs, const index_iterator& rhs) noexcept
+    {
+        return lhs.node_ == rhs.node_ &&
+               lhs.traversal_ == rhs.traversal_;
+    }
+
+    friend bool operator!=(const index_iterator& lhs, const index_iterator& rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+    const Owner* owner_;
+    std::uint32_t node_;
+    traversal_t traversal_;
+    level_t level_;
+};
+
+template<typename Owner>
+struct index_post_order
+{
+    using iterator = index_iterator<Owner>;
+
+    index_post_order(const Owner* owner) noexcept :
+        owner_(owner) {}
+
+    iterator end() const noexcept
+    {
+        return iterator(owner_, 0, iterator::traversal_t::TAIL, 0);
+    }
+
+    iterator begin() const noexcept
+    {
+        return ++end();
+    }
+
+    private:
+        const Owner* owner_;
+};
+
+// read-only part of index_forest and mapped_forest,
+// Derived gives nodes(), values() and size()
+template<typename Derived, typename T>
+class index_forest_base
+{
+    public:
+        using value_type = T;
+        using iterator = index_iterator<Derived>;
+        using const_iterator = index_iterator<Derived>;
+        using level_t = detail::node_base_t::level_t;
+
+        iterator begin() const noexcept
+        {
+            return ++end();
+        }
+
+        iterator end() const noexcept
+        {
+            return iterator(derived(), 0, iterator::traversal_t::LEAD, 0);
+        }
+
+        index_post_order<Derived> get_post_order() const noexcept
+        {
+            return index_post_order<Derived>(derived());
+        }
+
+        level_t get_level(const iterator pos) const noexcept
+        {
+            return pos.level_;
+        }
+
+        bool is_leaf(const iterator pos) const noexcept
+        {
+            auto& node = derived()->nodes()[pos.node_];
+            return node.next_[iterator::traversal_t::LEAD] ==
+                   detail::index_link(pos.node_, iterator::traversal_t::TAIL);
+        }
+
+        // pre-order iterator, end() for roots
+        iterator parent(const iterator pos) const noexcept
+        {
+            auto level = pos.level_ > 0 ? pos.level_ - 1 : 0;
+            return iterator(derived(), derived()->nodes()[pos.node_].parent_,
+                            iterator::traversal_t::LEAD, level);
+        }
+
+        bool empty() const noexcept
+        {
+            return derived()->size() == 0;
+        }
+
+        // image for mapped_forest, see detail::index_image_header_t
+        void write(std::ostream& out) const
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "forest: only raw values can be mapped");
+
+            auto size = derived()->size();
+            auto header = detail::make_index_image_header(size, sizeof(T), alignof(T));
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(derived()->nodes()),
+                      (size + 1) * sizeof(detail::index_node_t));
+            for (auto pos = sizeof(header) + (size + 1) * sizeof(detail::index_node_t);
+                 pos < header.values_offset_; ++pos)
+            {
+                out.put(0);
+            }
+            out.write(reinterpret_cast<const char*>(derived()->values()), size * sizeof(T));
+            if (!out)
+            {
+                throw std::runtime_error("forest: write failed");
+            }
+        }
+
+    private:
+        const Derived* derived() const noexcept
+        {
+            return static_cast<const Derived*>(this);
+        }
+};
+
+template<typename Lhs, typename Rhs, typename T>
+bool operator==(const index_forest_base<Lhs, T>& lhs, const index_forest_base<Rhs, T>& rhs) noexcept
+{
+    auto& derived_lhs = static_cast<const Lhs&>(lhs);
+    auto& derived_rhs = static_cast<const Rhs&>(rhs);
+    if (derived_lhs.size() != derived_rhs.size())
+    {
+        return false;
+    }
+
+    auto it = derived_rhs.begin();
+    for (auto pos = derived_lhs.begin(); pos != derived_lhs.end(); ++pos, ++it)
+    {
+        if (derived_lhs.get_level(pos) != derived_rhs.get_level(it) || !(*pos == *it))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Lhs, typename Rhs, typename T>
+bool operator!=(const index_forest_base<Lhs, T>& lhs, const index_forest_base<Rhs, T>& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+// forest in two arrays, the nodes linked by 32-bit indices
+// and the values, so it can be written out and mapped back as is;
+// nodes are appended, never erased one by one
+// (erasing is what forest is for)
+template<typename T>
+class index_forest : public index_forest_base<index_forest<T>, T>
+{
+    using base_t = index_forest_base<index_forest<T>, T>;
+
+    public:
+        using typename base_t::iterator;
+        using typename base_t::level_t;
+
+        index_forest() :
+            nodes_(1)
+        {
+            make_leaf(0);
+            auto& header = nodes_[0];
+            header.pred_[detail::pass_base_t::type_t::LEAD] = detail::index_link(0, detail::pass_base_t::type_t::TAIL);
+            header.next_[detail::pass_base_t::type_t::TAIL] = detail::index_link(0, detail::pass_base_t::type_t::LEAD);
+            header.parent_ = 0;
+        }
+
+        // anything with pre-order begin/end and get_level
+        template<typename Forest>
+        explicit index_forest(const Forest& src) : index_forest()
+        {
+            // the last node seen on every level, the header on 0
+            std::vector<std::uint32_t> path(1, 0);
+            for (auto it = src.begin(); it != src.end(); ++it)
+            {
+                path.resize(src.get_level(it));
+                path.push_back(append(path.back(), *it));
+            }
+        }
+
+        // new node becomes the last child of pos, end() makes a root
+        // iterators stay valid, references to the values do not
+        // throws std::length_error past detail::max_index_size nodes
+        iterator insert(const iterator pos, const T& value)
+        {
+            return iterator(this, append(pos.node_, value),
+                            iterator::traversal_t::LEAD, pos.level_ + 1);
+        }
+
+        iterator insert(const iterator pos, T&& value)
+        {
+            return iterator(this, append(pos.node_, std::move(value)),
+                            iterator::traversal_t::LEAD, pos.level_ + 1);
+        }
+
+        void reserve(std::size_t size)
+        {
+            nodes_.reserve(size + 1);
+            values_.reserve(size);
+        }
+
+        void clear() noexcept
+        {
+            nodes_.resize(1);
+            values_.clear();
+            make_leaf(0);
+        }
+
+        std::size_t size() const noexcept
+        {
+            return values_.size();
+        }
+
+        const detail::index_node_t* nodes() const noexcept
+        {
+            return nodes_.data();
+        }
+
+        const T* values() const noexcept
+        {
+            return values_.data();
+        }
+
+    private:
+        using pass_base_t = detail::pass_base_t;
+        using index_link_t = detail::index_link_t;
+
+        void make_leaf(std::uint32_t node) noexcept
+        {
+            nodes_[node].next_[pass_base_t::type_t::LEAD] = detail::index_link(node, pass_base_t::type_t::TAIL);
+            nodes_[node].pred_[pass_base_t::type_t::TAIL] = detail::index_link(node, pass_base_t::type_t::LEAD);
+        }
+
+        index_link_t& link(index_link_t pass, pass_base_t::direction_t dir) noexcept
+        {
+            auto& node = nodes_[pass >> 1];
+            return dir == pass_base_t::direction_t::NEXT ? node.next_[pass & 1] : node.pred_[pass & 1];
+        }
+
+        // the same as forest's bind_last_child
+        template<typename U>
+        std::uint32_t append(std::uint32_t parent, U&& value)
+        {
+            if (size() >= detail::max_index_size)
+            {
+                throw std::length_error("forest: too many nodes for an index forest");
+            }
+            values_.push_back(std::forward<U>(value));
+            try
+            {
+                nodes_.emplace_back();
+            }
+            catch (...)
+            {
+                values_.pop_back();
+                throw;
+            }
+
+            auto leaf = static_cast<std::uint32_t>(nodes_.size() - 1);
+            auto next_link = detail::index_link(parent, pass_base_t::type_t::TAIL);
+            auto pred_link = link(next_link, pass_base_t::direction_t::PRED);
+            make_leaf(leaf);
+            nodes_[leaf].parent_ = parent;
+            nodes_[leaf].next_[pass_base_t::type_t::TAIL] = next_link;
+            nodes_[leaf].pred_[pass_base_t::type_t::LEAD] = pred_link;
+            link(next_link, pass_base_t::direction_t::PRED) = detail::index_link(leaf, pass_base_t::type_t::TAIL);
+            link(pred_link, pass_base_t::direction_t::NEXT) = detail::index_link(leaf, pass_base_t::type_t::LEAD);
+            return leaf;
+        }
+
+        std::vector<detail::index_node_t> nodes_;
+        std::vector<T> values_;
+};
+
+// read-only index forest straight from a file written by write,
+// nothing is read or copied until it is walked;
+// the image is trusted past its header
+template<typename T>
+class mapped_forest : public index_forest_base<mapped_forest<T>, T>
+{
+    static_assert(std::is_trivially_copyable_v<T>, "forest: only raw values can be mapped");
+
+    public:
+        // throws std::system_error if the file can not be mapped
+        // and std::runtime_error if it is not an image of index_forest<T>
+        explicit mapped_forest(const char* path) :
+            file_(path)
+        {
+            auto& header = detail::check_index_image(file_.data(), file_.size(), sizeof(T), alignof(T));
+            size_ = header.size_;
+            nodes_ = reinterpret_cast<const detail::index_node_t*>(file_.data() + sizeof(header));
+            values_ = reinterpret_cast<const T*>(file_.data() + header.values_offset_);
+        }
+
+        std::size_t size() const noexcept
+        {
+            return size_;
+        }
+
+        const detail::index_node_t* nodes() const noexcept
+        {
+            return nodes_;
+        }
+
+        const T* values() const noexcept
+        {
+            return values_;
+        }
+
+    private:
+        detail::mapped_file file_;
+        std::size_t size_;
+        const detail::index_node_t* nodes_;
+        const T* values_;
+};
+
+} //forest
+#endif //INDEX_TREE_LIB
@@ -0,0 +1,355 @@
+#ifndef LCA_TREE_LIB
+#define LCA_TREE_LIB
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "forest.hpp"
+
+namespace forestlib
+{
+
+namespace detail
+{
+    // ancestry and lowest common ancestors over pre-order indices:
+    // a subtree is an interval, so ancestry is containment;
+    // the shallowest nodes after a and up to b are children of lca(a, b),
+    // so lca is a range minimum of (level, parent)
+    class lca_table
+    {
+        public:
+            static constexpr std::uint32_t none = 0xffffffffu;
+            // scanned whole, the minima of blocks go to a sparse table
+            static constexpr std::size_t block_size = 32;
+
+            // levels of the nodes in pre-order, a valid one;
+            // throws std::length_error past 2^32 - 1 nodes
+            void build(const std::vector<node_base_t::level_t>& levels);
+
+            std::size_t size() const noexcept
+            {
+                return ends_.size();
+            }
+
+            // a node is its own ancestor
+            bool is_ancestor(std::uint32_t ancestor, std::uint32_t node) const noexcept
+            {
+                return ancestor <= node && node < ends_[ancestor];
+            }
+
+            // none for nodes in different trees
+            std::uint32_t lca(std::uint32_t lhs, std::uint32_t rhs) const noexcept;
+
+        private:
+            // of keys_ in [first, last), not empty
+            std::uint64_t range_min(std::size_t first, std::size_t last) const noexcept;
+            std::uint64_t scan(std::size_t first, std::size_t last) const noexcept;
+
+            // one past the subtree
+            std::vector<std::uint32_t> ends_;
+            // level above, parent below
+            std::vector<std::uint64_t> keys_;
+            // row k holds the minima of 2^k blocks from every block on
+            std::vector<std::uint64_t> table_;
+            std::vector<std::uint8_t> logs_;
+            std::size_t blocks_ = 0;
+    };
+
+    template<typename Forest, typename = void>
+    struct has_version : std::false_type {};
+
+    template<typename Forest>
+    struct has_version<Forest, std::void_t<decltype(std::declval<const Forest&>().version())>> :
+        std::true_type {};
+
+    // ancestors by level: the one on level l of a node is the last node
+    // of that level up to it in pre-order
+    class level_table
+    {
+        public:
+            using level_t = node_base_t::level_t;
+
+            static constexpr std::uint32_t none = lca_table::none;
+
+            // levels of the nodes in pre-order, a valid one;
+            // throws std::length_error past 2^32 - 1 nodes
+            void build(const std::vector<level_t>& levels);
+
+            std::size_t size() const noexcept
+            {
+                return levels_.size();
+            }
+
+            level_t level(std::uint32_t node) const noexcept
+            {
+                return levels_[node];
+            }
+
+            // none for level 0 or one below the node: O(log n)
+            std::uint32_t ancestor(std::uint32_t node, level_t level) const noexcept;
+
+            // (node, level) queries sorted by node, answers in the same order:
+            // one sweep over the nodes in between keeps the path at hand,
+            // sparse batches are answered one by one
+            void ancestors(const std::pair<std::uint32_t, level_t>* first,
+                           const std::pair<std::uint32_t, level_t>* last,
+                           std::uint32_t* out) const;
+
+        private:
+            std::vector<level_t> levels_;
+            // nodes of level l in pre-order are [starts_[l - 1], starts_[l]) of by_level_
+            std::vector<std::uint32_t> starts_;
+            std::vector<std::uint32_t> by_level_;
+    };
+
+    // nodes of a forest as it was when (re)built, by iterators and by
+    // pre-order indices; current() tells if the forest changed since
+    // (always true for ones without version(), frozen_forest is immutable)
+    template<typename Forest>
+    class node_indices
+    {
+        public:
+            using iterator = decltype(std::declval<const Forest&>().begin());
+            using level_t = node_base_t::level_t;
+
+            static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+            bool current() const noexcept
+            {
+                return version_ == version_of(*source_);
+            }
+
+            std::size_t size() const noexcept
+            {
+                return nodes_.size();
+            }
+
+            // npos for a node the forest did not have when built
+            std::size_t index_of(iterator pos) const
+            {
+                auto found = indices_.find(&*pos);
+                return found == indices_.end() ? npos : found->second;
+            }
+
+            iterator node(std::size_t index) const noexcept
+            {
+                return nodes_[index];
+            }
+
+        protected:
+            explicit node_indices(const Forest& src) :
+                source_(&src), version_(0) {}
+
+            // levels of the forest as it is now, memory is reused
+            std::vector<level_t> collect()
+            {
+                nodes_.clear();
+                indices_.clear();
+                std::vector<level_t> levels;
+                levels.reserve(source_->size());
+                nodes_.reserve(source_->size());
+                indices_.reserve(source_->size());
+                for (auto it = source_->begin(); it != source_->end(); ++it)
+                {
+                    indices_.emplace(&*it, static_cast<std::uint32_t>(nodes_.size()));
+                    levels.push_back(source_->get_level(it));
+                    nodes_.push_back(it);
+                }
+                version_ = version_of(*source_);
+                return levels;
+            }
+
+            // npos for none
+            iterator node_or_end(std::size_t index) const noexcept
+            {
+                return index == npos ? source_->end() : nodes_[index];
+            }
+
+        private:
+            static std::uint64_t version_of(const Forest& src) noexcept
+            {
+                if constexpr (has_version<Forest>::value)
+                {
+                    return src.version();
+                }
+                else
+                {
+                    return 0;
+                }
+            }
+
+            const Forest* source_;
+            std::uint64_t version_;
+            std::vector<iterator> nodes_;
+            std::unordered_map<const void*, std::uint32_t> indices_;
+    };
+}
+
+// ancestor tests and lowest common ancestors in O(1) for a forest
+// with pre-order begin/end and get_level, see node_indices;
+// indices skip a hash lookup
+template<typename Forest>
+class lca_index : public detail::node_indices<Forest>
+{
+    public:
+        using base_t = detail::node_indices<Forest>;
+        using typename base_t::iterator;
+        using base_t::npos;
+
+        explicit lca_index(const Forest& src) :
+            base_t(src)
+        {
+            rebuild();
+        }
+
+        // from the forest as it is now, memory is reused
+        void rebuild()
+        {
+            table_.build(this->collect());
+        }
+
+        // a node is its own ancestor; indices are below size()
+        bool is_ancestor(std::size_t ancestor, std::size_t node) const noexcept
+        {
+            assert(ancestor < this->size() && node < this->size() && "unknown node");
+            return table_.is_ancestor(static_cast<std::uint32_t>(ancestor),
+                                      static_cast<std::uint32_t>(node));
+        }
+
+        // false for a node the forest did not have when built
+        bool is_ancestor(iterator ancestor, iterator node) const
+        {
+            auto ancestor_index = this->index_of(ancestor);
+            auto node_index = this->index_of(node);
+            return ancestor_index != npos && node_index != npos &&
+                   is_ancestor(ancestor_index, node_index);
+        }
+
+        // npos for nodes in different trees; indices are below size()
+        std::size_t lca(std::size_t lhs, std::size_t rhs) const noexcept
+        {
+            assert(lhs < this->size() && rhs < this->size() && "unknown node");
+            auto found = table_.lca(static_cast<std::uint32_t>(lhs), static_cast<std::uint32_t>(rhs));
+            return found == detail::lca_table::none ? npos : found;
+        }
+
+        // the forest's end() for nodes in different trees
+        // and for a node the forest did not have when built
+        iterator lca(iterator lhs, iterator rhs) const
+        {
+            auto lhs_index = this->index_of(lhs);
+            auto rhs_index = this->index_of(rhs);
+            if (lhs_index == npos || rhs_index == npos)
+            {
+                return this->node_or_end(npos);
+            }
+            return this->node_or_end(lca(lhs_index, rhs_index));
+        }
+
+        // pairs of indices or of iterators in, what lca gives for each out
+        template<typename InputIt, typename OutputIt>
+        OutputIt lca(InputIt first, InputIt last, OutputIt out) const
+        {
+            for (; first != last; ++first, ++out)
+            {
+                *out = lca(first->first, first->second);
+            }
+            return out;
+        }
+
+    private:
+        detail::lca_table table_;
+};
+
+// ancestor of a node on a given level (the root's is 1) in O(log n),
+// sorted batches in one sweep; see node_indices
+template<typename Forest>
+class level_ancestor_index : public detail::node_indices<Forest>
+{
+    public:
+        using base_t = detail::node_indices<Forest>;
+        using typename base_t::iterator;
+        using typename base_t::level_t;
+        using base_t::npos;
+
+        explicit level_ancestor_index(const Forest& src) :
+            base_t(src)
+        {
+            rebuild();
+        }
+
+        // from the forest as it is now, memory is reused
+        void rebuild()
+        {
+            table_.build(this->collect());
+        }
+
+        // npos for level 0 or one below the node; node is below size()
+        std::size_t level_ancestor(std::size_t node, level_t level) const noexcept
+        {
+            assert(node < this->size() && "unknown node");
+            return from_table(table_.ancestor(static_cast<std::uint32_t>(node), level));
+        }
+
+        // the forest's end() for level 0 or one below pos
+        // and for a node the forest did not have when built
+        iterator level_ancestor(iterator pos, level_t level) const
+        {
+            auto index = this->index_of(pos);
+            return this->node_or_end(index == npos ? npos : level_ancestor(index, level));
+        }
+
+        // k levels up, the node itself for 0; npos past the root;
+        // node is below size()
+        std::size_t kth_ancestor(std::size_t node, level_t k) const noexcept
+        {
+            assert(node < this->size() && "unknown node");
+            auto level = table_.level(static_cast<std::uint32_t>(node));
+            return k < level ? level_ancestor(node, level - k) : npos;
+        }
+
+        // the forest's end() past the root and for a node
+        // the forest did not have when built
+        iterator kth_ancestor(iterator pos, level_t k) const
+        {
+            auto index = this->index_of(pos);
+            return this->node_or_end(index == npos ? npos : kth_ancestor(index, k));
+        }
+
+        // (node index, level) pairs sorted by node in, what level_ancestor
+        // gives for each out; nodes are below size()
+        template<typename InputIt, typename OutputIt>
+        OutputIt level_ancestors(InputIt first, InputIt last, OutputIt out) const
+        {
+            std::vector<std::pair<std::uint32_t, level_t>> queries;
+            for (; first != last; ++first)
+            {
+                assert(first->first < this->size() && "unknown node");
+                queries.emplace_back(static_cast<std::uint32_t>(first->first), first->second);
+            }
+            std::vector<std::uint32_t> found(queries.size());
+            table_.ancestors(queries.data(), queries.data() + queries.size(), found.data());
+            for (auto ancestor : found)
+            {
+                *out++ = from_table(ancestor);
+            }
+            return out;
+        }
+
+    private:
+        static std::size_t from_table(std::uint32_t node) noexcept
+        {
+            return node == detail::level_table::none ? npos : node;
+        }
+
+        detail::level_table table_;
+};
+
+} //forest
+#endif //LCA_TREE_LIB
@@ -1,8 +1,27 @@
 #include <iostream>
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <iterator>
+#include <random>
+#include <utility>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "forest.hpp"
+#include "eulerforest.hpp"
+#include "frozenforest.hpp"
+#include "indexforest.hpp"
+#include "lcaindex.hpp"
+#include "parallelforest.hpp"
+#include "snapshotforest.hpp"
 
 auto main() -> int
 {
@@ -58,6 +77,106 @@ auto main() -> int
     Dump(second_one);
     std::cout << std::endl;
 
+    std::cout << "Can I walk around?" << std::endl;
+    std::cout << "Children of [" << *left_subforest << "]: ";
+    for (auto child : second_one.children(left_subforest))
+    {
+        std::cout << child << " ";
+    }
+    std::cout << std::endl;
+    if (*three.parent() == 1 && *three.prev_sibling() == 2 &&
+        *left_subforest.skip_subtree() == 6 && left_subforest.parent() == second_one.end())
+    {
+        std::cout << "Parents, siblings and skips are fine" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, you got lost" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I walk it level by level?" << std::endl;
+    std::vector<unsigned> by_levels;
+    for (auto value : second_one.get_level_order())
+    {
+        by_levels.push_back(value);
+        std::cout << value << " ";
+    }
+    std::cout << std::endl;
+    auto third_level = second_one.get_level_order(3);
+    if (by_levels == std::vector<unsigned>{1, 6, 2, 3, 4, 5} &&
+        *third_level.begin() == 4 && std::distance(third_level.begin(), third_level.end()) == 2)
+    {
+        std::cout << "Roots first, leaves last" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, the levels are mixed up" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I enter and leave every node in one walk?" << std::endl;
+    std::ostringstream nested;
+    forestlib::euler_walk(second_one,
+        [&nested] (forestlib::forest<unsigned>::iterator pos) { nested << "(" << *pos; return *pos != 3; },
+        [&nested] (forestlib::forest<unsigned>::iterator) { nested << ")"; });
+    std::cout << nested.str() << std::endl;
+    if (nested.str() == "(1(2)(3))(6)")
+    {
+        std::cout << "In and out, [3] is skipped" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, it's unbalanced" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I find common ancestors?" << std::endl;
+    forestlib::forest<unsigned> asked_one = second_one;
+    forestlib::lca_index<forestlib::forest<unsigned>> lcas(asked_one);
+    auto asked_four = std::next(asked_one.begin(), 3);
+    auto asked_five = std::next(asked_one.begin(), 4);
+    auto asked_six = std::next(asked_one.begin(), 5);
+    // not in the index
+    auto late_one = asked_one.insert(asked_six, 7);
+    if (*lcas.lca(asked_four, asked_five) == 3 && *lcas.lca(asked_one.begin().first_child(), asked_five) == 1 &&
+        lcas.lca(asked_four, asked_six) == asked_one.end() && lcas.lca(late_one, asked_six) == asked_one.end() &&
+        lcas.is_ancestor(asked_one.begin(), asked_five) && !lcas.is_ancestor(asked_five, asked_one.begin()) &&
+        !lcas.is_ancestor(asked_six, late_one) && lcas.lca(3, 4) == 2 && lcas.lca(0, 5) == lcas.npos)
+    {
+        std::cout << "Found, a late one has none" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, they are strangers" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I go up to a level or k levels?" << std::endl;
+    forestlib::level_ancestor_index<forestlib::forest<unsigned>> ups(asked_one);
+    auto later_one = asked_one.insert(asked_five, 8);
+    std::pair<std::size_t, unsigned> up_queries[] = {{3, 1}, {3, 2}, {4, 3}, {5, 2}};
+    std::vector<std::size_t> ups_found;
+    ups.level_ancestors(std::begin(up_queries), std::end(up_queries), std::back_inserter(ups_found));
+    if (*ups.level_ancestor(asked_four, 1) == 1 && *ups.level_ancestor(asked_four, 2) == 3 &&
+        ups.level_ancestor(asked_four, 4) == asked_one.end() && *ups.kth_ancestor(asked_five, 0) == 5 &&
+        *ups.kth_ancestor(asked_five, 2) == 1 && ups.kth_ancestor(asked_five, 3) == asked_one.end() &&
+        ups.level_ancestor(later_one, 1) == asked_one.end() && ups.kth_ancestor(later_one, 1) == asked_one.end() &&
+        ups_found == std::vector<std::size_t>{0, 2, 4, ups.npos})
+    {
+        std::cout << "Went up, a late one stays put" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, lost on the way up" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
     forestlib::forest copied_one = second_one;
     std::cout << "Is it ok after copying?" << std::endl;
     if (copied_one == second_one)
@@ -71,6 +190,372 @@ auto main() -> int
     }
     std::cout << std::endl;
 
+    std::cout << "Can I build it from what Dump prints?" << std::endl;
+    std::pair<unsigned, unsigned> dumped[] = {{1, 1}, {2, 2}, {2, 3}, {3, 4}, {3, 5}, {1, 6}};
+    forestlib::forest<unsigned> assigned_one(std::begin(dumped), std::end(dumped));
+    if (assigned_one == second_one && assigned_one.get_level(--(--assigned_one.end())) == 3)
+    {
+        std::cout << "Built in one go" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, it's another one" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I freeze it?" << std::endl;
+    auto frozen_one = second_one.freeze();
+    Dump(frozen_one);
+    if (frozen_one.subtree_size(frozen_one.begin()) == 5 &&
+        frozen_one.thaw() == second_one)
+    {
+        std::cout << "Frozen and thawed" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, it melted" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I save it and load it back?" << std::endl;
+    std::stringstream stream;
+    second_one.save(stream);
+    forestlib::forest<unsigned> loaded_one;
+    loaded_one.load(stream);
+    forestlib::forest<std::string> named_one;
+    named_one.insert(named_one.insert(named_one.end(), "root"), "leaf");
+    named_one.save(stream);
+    forestlib::forest<std::string> loaded_named_one;
+    loaded_named_one.load(stream);
+    std::ostringstream named_out;
+    named_one.save(named_out);
+    auto corrupt_bytes = named_out.str();
+    // "root" claims to be about 2^62 characters long
+    auto root_at = corrupt_bytes.find("\x04root");
+    corrupt_bytes.replace(root_at, 1, "\xff\xff\xff\xff\xff\xff\xff\xff\x7f");
+    std::istringstream corrupt_in(corrupt_bytes);
+    bool corrupt_refused = false;
+    try
+    {
+        forestlib::forest<std::string> corrupt_one;
+        corrupt_one.load(corrupt_in);
+    }
+    catch (const std::runtime_error&)
+    {
+        corrupt_refused = true;
+    }
+    if (loaded_one == second_one && loaded_named_one == named_one &&
+        root_at != std::string::npos && corrupt_refused)
+    {
+        std::cout << "Saved and loaded" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, it got lost on the way" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I write it as an image and map it back?" << std::endl;
+    forestlib::index_forest<unsigned> indexed_one(second_one);
+    auto image = std::filesystem::temp_directory_path() / "testforest.img";
+    auto short_image = std::filesystem::temp_directory_path() / "testforest.short.img";
+    std::string image_bytes;
+    {
+        std::ostringstream out;
+        indexed_one.write(out);
+        image_bytes = out.str();
+        std::ofstream(image, std::ios::binary) << image_bytes;
+        // cut in the middle of the nodes
+        std::ofstream(short_image, std::ios::binary) << image_bytes.substr(0, image_bytes.size() / 2);
+    }
+    bool mapped_back = false;
+    bool short_rejected = false;
+    {
+        forestlib::mapped_forest<unsigned> mapped_one(image.c_str());
+        Dump(mapped_one);
+        mapped_back = mapped_one == indexed_one && mapped_one.size() == 6 &&
+                      mapped_one.get_level(--(--mapped_one.end())) == 3;
+        try
+        {
+            forestlib::mapped_forest<unsigned> short_one(short_image.c_str());
+        }
+        catch (const std::runtime_error&)
+        {
+            short_rejected = true;
+        }
+    }
+    std::filesystem::remove(image);
+    std::filesystem::remove(short_image);
+    if (mapped_back && short_rejected)
+    {
+        std::cout << "Mapped back, a cut one is refused" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, the image is broken" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I sum up the subtrees?" << std::endl;
+    auto sums = forestlib::parallel::reduce_subtrees(second_one,
+                                                     [] (unsigned value) { return value; },
+                                                     [] (unsigned acc, unsigned child) { return acc + child; });
+    for (auto sum : sums)
+    {
+        std::cout << sum << " ";
+    }
+    std::cout << std::endl;
+    if (sums.size() == 6 && sums[0] == 15 && sums[2] == 12 && sums[5] == 6)
+    {
+        std::cout << "Summed up" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, it doesn't add up" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Do big subtrees fold the same on four threads as on one?" << std::endl;
+    forestlib::parallel::thread_pool four_threads(4);
+    forestlib::parallel::thread_pool one_thread(1);
+    // more nodes than a few fold blocks take, so blocks are folded apart
+    // and the subtrees open over their ends are finished after them
+    auto grow = [] (char shape)
+    {
+        const std::size_t big_size = 1 << 16;
+        forestlib::forest<unsigned> grown;
+        std::vector<forestlib::forest<unsigned>::iterator> nodes(1, grown.end());
+        std::mt19937 gen(42);
+        for (std::size_t i = 0; i < big_size; ++i)
+        {
+            // chain under the last one, star under the first one, random under any
+            auto parent = shape == 'c' ? nodes.back() :
+                          shape == 's' ? nodes[std::min<std::size_t>(i, 1)] :
+                                         nodes[std::uniform_int_distribution<std::size_t>(0, i)(gen)];
+            nodes.push_back(grown.insert(parent, static_cast<unsigned>(i)));
+        }
+        return grown;
+    };
+    // x -> first * x + second composed, associative but not commutative:
+    // children combined out of order give other results
+    using affine_t = std::pair<std::uint64_t, std::uint64_t>;
+    auto to_affine = [] (unsigned value) { return affine_t(2 * value + 1, value); };
+    auto compose = [] (const affine_t& acc, const affine_t& child)
+    {
+        return affine_t(acc.first * child.first, acc.first * child.second + acc.second);
+    };
+    bool folds_agree = true;
+    for (char shape : {'c', 's', 'r'})
+    {
+        auto big_one = grow(shape);
+        auto folded_apart = forestlib::parallel::reduce_subtrees(big_one, to_affine, compose, four_threads);
+        auto folded_alone = forestlib::parallel::reduce_subtrees(big_one, to_affine, compose, one_thread);
+        std::cout << shape << ": " << folded_apart.front().first << " " << folded_apart.front().second << std::endl;
+        folds_agree = folds_agree && folded_apart == folded_alone;
+    }
+    if (folds_agree)
+    {
+        std::cout << "Chain, star and random fold alike" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, threads change the result" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I visit and map big forests on four threads?" << std::endl;
+    bool visited_alike = true;
+    for (char shape : {'c', 's', 'r'})
+    {
+        auto visited_one = grow(shape);
+        auto walked_one = visited_one;
+        std::atomic<std::size_t> visits(0);
+        // a node visited twice or missed would differ from the walk
+        forestlib::parallel::for_each(visited_one, [&visits] (unsigned& value)
+        {
+            value = value * 3 + 1;
+            ++visits;
+        }, four_threads);
+        for (auto& value : walked_one)
+        {
+            value = value * 3 + 1;
+        }
+
+        auto mapped_one = visited_one;
+        forestlib::parallel::transform(visited_one, mapped_one,
+                                       [] (unsigned value) { return value ^ 0x5555u; }, four_threads);
+        auto walked_pos = walked_one.begin();
+        for (auto mapped_pos = mapped_one.begin(); mapped_pos != mapped_one.end(); ++mapped_pos, ++walked_pos)
+        {
+            visited_alike = visited_alike && *mapped_pos == (*walked_pos ^ 0x5555u);
+        }
+        visited_alike = visited_alike && visits == walked_one.size() && visited_one == walked_one;
+    }
+    bool shape_refused = false;
+    try
+    {
+        auto small_one = second_one;
+        forestlib::parallel::transform(grow('r'), small_one, [] (unsigned value) { return value; }, four_threads);
+    }
+    catch (const std::invalid_argument&)
+    {
+        shape_refused = true;
+    }
+    if (visited_alike && shape_refused)
+    {
+        std::cout << "Every node once, another shape is refused" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, the threads trip over each other" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Do readers keep their version while it is published over?" << std::endl;
+    forestlib::snapshot_forest<unsigned> snapshots(second_one);
+    bool versions_kept = false;
+    {
+        auto old_reader = snapshots.read();
+        snapshots.draft().insert(snapshots.draft().end(), 7);
+        snapshots.publish();
+        auto new_reader = snapshots.read();
+        Dump(*new_reader);
+        versions_kept = old_reader->size() == 6 && old_reader->thaw() == second_one &&
+                        new_reader->size() == 7 && new_reader->thaw() == snapshots.draft();
+    }
+    snapshots.reclaim();
+    // retired ones go once the readers that could see them leave
+    unsigned freed = 0;
+    auto count_freed = [] (void* counter) { ++*static_cast<unsigned*>(counter); };
+    bool retired_kept = false;
+    {
+        forestlib::detail::epoch_domain domain;
+        auto early_slot = domain.enter();
+        domain.reserve();
+        domain.retire(&freed, count_freed);
+        auto late_slot = domain.enter();
+        domain.reclaim();
+        retired_kept = freed == 0;
+        domain.leave(early_slot);
+        domain.reclaim();
+        domain.leave(late_slot);
+    }
+    if (versions_kept && retired_kept && freed == 1)
+    {
+        std::cout << "Old readers see the old one, new ones the new one" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, the versions got mixed up" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I move a subtree and sum it up again?" << std::endl;
+    forestlib::euler_forest<unsigned> tour(second_one);
+    // [3] goes under [6]
+    auto moved = tour.move_subtree(std::next(tour.begin(), 2), std::next(tour.begin(), 5));
+    Dump(tour);
+    if (tour.aggregate(tour.begin()) == 3 && tour.get_level(moved) == 2 &&
+        tour.subtree_size(std::next(tour.begin(), 2)) == 4 && tour.aggregate(std::next(tour.begin(), 2)) == 18)
+    {
+        std::cout << "Moved and summed" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, it fell apart" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I count my way to a node and back?" << std::endl;
+    auto tour_post = tour.get_post_order();
+    auto third_node = tour.nth(3);
+    if (third_node == moved && tour.get_level(third_node) == 2 && tour.rank(moved) == 3 &&
+        tour.nth(tour.size()) == tour.end() && tour.rank(tour.end()) == tour.size() &&
+        *tour_post.nth(4) == 3 && tour.get_level(tour_post.nth(4)) == 2 &&
+        tour.rank(tour_post.nth(4)) == 4 && tour_post.nth(tour.size()) == tour_post.end() &&
+        tour.distance(tour.begin(), moved) == 3)
+    {
+        std::cout << "Counted both ways" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, miscounted" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Can I move things in?" << std::endl;
+    forestlib::forest<std::unique_ptr<int>> unique_one;
+    auto unique_root = unique_one.emplace(unique_one.end(), new int(1));
+    unique_one.insert(unique_root, std::make_unique<int>(3));
+    unique_one.emplace_front_child(unique_root, std::make_unique<int>(2));
+    if (**unique_root == 1 && **unique_root.first_child() == 2 && **unique_root.last_child() == 3)
+    {
+        std::cout << "Moved and emplaced" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, it's lost" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Do values share the forest's memory, wherever it goes?" << std::endl;
+    // the arenas can not grow, nothing may be taken from elsewhere
+    char first_buffer[1 << 16];
+    char second_buffer[1 << 16];
+    std::pmr::monotonic_buffer_resource first_arena(first_buffer, sizeof(first_buffer),
+                                                    std::pmr::null_memory_resource());
+    std::pmr::monotonic_buffer_resource second_arena(second_buffer, sizeof(second_buffer),
+                                                     std::pmr::null_memory_resource());
+    // on the arena a forest is in, values long enough to leave the string
+    auto in_arena = [] (const forestlib::pmr::forest<std::pmr::string>& any_forest,
+                        std::pmr::memory_resource* arena)
+    {
+        bool inside = any_forest.get_allocator().resource() == arena;
+        for (auto& value : any_forest)
+        {
+            inside = inside && value.get_allocator().resource() == arena;
+        }
+        return inside;
+    };
+    forestlib::pmr::forest<std::pmr::string> arena_one(&first_arena);
+    auto arena_root = arena_one.insert(arena_one.end(), "a root too long for a short string");
+    arena_one.insert(arena_root, "a leaf too long for a short string, too");
+    // copied from: the default resource, as select_on_container_copy_construction says
+    forestlib::pmr::forest<std::pmr::string> default_copy(arena_one);
+    // assigned to: keep their own arena, the values are copied or moved one by one
+    forestlib::pmr::forest<std::pmr::string> copy_assigned(&second_arena);
+    copy_assigned = arena_one;
+    forestlib::pmr::forest<std::pmr::string> move_source(arena_one, &first_arena);
+    forestlib::pmr::forest<std::pmr::string> move_assigned(&second_arena);
+    move_assigned = std::move(move_source);
+    forestlib::pmr::forest<std::pmr::string> move_source_too(arena_one, &first_arena);
+    forestlib::pmr::forest<std::pmr::string> moved_over(std::move(move_source_too), &second_arena);
+    if (in_arena(arena_one, &first_arena) &&
+        in_arena(default_copy, std::pmr::get_default_resource()) && default_copy == arena_one &&
+        in_arena(copy_assigned, &second_arena) && copy_assigned == arena_one &&
+        in_arena(move_assigned, &second_arena) && move_assigned == arena_one &&
+        in_arena(moved_over, &second_arena) && moved_over == arena_one)
+    {
+        std::cout << "Every value lives where its forest does" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, they leak into other memory" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
     std::cout << "Does clear work?" << std::endl;
     second_one.clear();
     if (second_one.empty() && second_one.begin() == second_one.end())
@@ -95,6 +580,114 @@ auto main() -> int
     std::cout << "Erased [" << *internal_node << "]:" << std::endl;
     copied_one.erase(internal_node);
     Dump(copied_one);
+    std::cout << std::endl;
+
+    std::cout << "Do kept iterators know their level after an ancestor goes?" << std::endl;
+    forestlib::forest<unsigned> chain_one;
+    auto grandparent = chain_one.insert(chain_one.end(), 1);
+    auto kept_parent = chain_one.insert(grandparent, 2);
+    auto kept_child = chain_one.insert(kept_parent, 3);
+    auto kept_post = chain_one.get_post_order().begin();
+    chain_one.erase(grandparent);
+    auto grandchild = chain_one.insert(kept_child, 4);
+    Dump(chain_one);
+    if (chain_one.get_level(kept_parent) == 1 && chain_one.get_level(kept_child) == 2 &&
+        chain_one.get_level(kept_post) == 2 && chain_one.get_level(grandchild) == 3 &&
+        chain_one.get_level(--chain_one.end()) == 3)
+    {
+        std::cout << "Levels are right" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, they are stale" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Do levels hold up when I change things through kept iterators?" << std::endl;
+    forestlib::forest<unsigned> kept_one;
+    auto kept_root = kept_one.insert(kept_one.end(), 1);
+    auto kept_middle = kept_one.insert(kept_one.insert(kept_root, 2), 3);
+    auto kept_leaf = kept_one.insert(kept_middle, 4);
+    kept_one.erase(kept_root);
+    kept_one.insert(kept_middle, 5);
+    kept_one.erase(kept_middle);
+    kept_one.insert(kept_leaf, 6);
+    Dump(kept_one);
+    std::vector<unsigned> kept_levels;
+    for (auto value : kept_one.get_level_order())
+    {
+        kept_levels.push_back(value);
+    }
+    auto second_level = kept_one.get_level_order(2);
+    if (kept_levels == std::vector<unsigned>{2, 4, 5, 6} &&
+        std::distance(second_level.begin(), second_level.end()) == 2 &&
+        *kept_one.get_level_order(3).begin() == 6)
+    {
+        std::cout << "Every node is on its level" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, they moved to other levels" << std::endl;
+        return -1;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Do the counters count?" << std::endl;
+    forestlib::reset_global_counters();
+    auto global_before = forestlib::global_counters();
+    forestlib::forest<unsigned> counted_one;
+    auto counted_root = counted_one.insert(counted_one.end(), 1);
+    auto counted_leaf = counted_one.insert(counted_root, 2);
+    auto counted_middle = counted_one.insert(counted_root, 3);
+    counted_one.insert(counted_middle, 4);
+    auto counted_pos = counted_one.begin();
+    auto global_built = forestlib::global_counters();
+    // 1 2 3 4 end: the tail of 2, those of 4, 3 and 1 and the header's are skipped
+    for (int step = 0; step < 4; ++step)
+    {
+        ++counted_pos;
+    }
+    auto global_walked = forestlib::global_counters();
+    counted_one.erase(counted_middle);
+    counted_one.erase(counted_leaf);
+    auto counted = counted_one.counters();
+    auto counted_copy = counted_one;
+    auto copy_counted = counted_copy.counters();
+    forestlib::reset_global_counters();
+    auto global_reset = forestlib::global_counters();
+    const std::uint64_t node_bytes = sizeof(forestlib::detail::node_t<unsigned>);
+    bool counts_right;
+    if (FORESTLIB_INSTRUMENT)
+    {
+        counts_right = global_before.nodes_allocated_ == 0 && global_built.nodes_allocated_ == 4 &&
+                       global_built.bytes_in_use_ - global_before.bytes_in_use_ == 4 * node_bytes &&
+                       global_walked.traverse_steps_ - global_built.traverse_steps_ == 4 &&
+                       (FORESTLIB_ORDER_THREADS || global_walked.pass_skips_ - global_built.pass_skips_ == 5) &&
+                       counted.nodes_allocated_ == 4 && counted.nodes_freed_ == 2 &&
+                       counted.bytes_in_use_ == 2 * node_bytes &&
+                       counted.internal_erases_ == 1 && counted.erase_walk_ >= 1 &&
+                       counted.copies_ == 0 && copy_counted.copies_ == 1 && copy_counted.copied_nodes_ == 2 &&
+                       copy_counted.nodes_allocated_ == 2 &&
+                       global_reset.nodes_allocated_ == 0 && global_reset.traverse_steps_ == 0 &&
+                       global_reset.copies_ == 0 && global_reset.bytes_in_use_ == global_walked.bytes_in_use_ &&
+                       counted_one.counters().nodes_allocated_ == 4;
+    }
+    else
+    {
+        // nothing is counted
+        counts_right = counted.nodes_allocated_ == 0 && global_built.nodes_allocated_ == 0 &&
+                       global_walked.traverse_steps_ == 0;
+    }
+    if (counts_right)
+    {
+        std::cout << "Counted what was done" << std::endl;
+    }
+    else
+    {
+        std::cout << "No, the counts are off" << std::endl;
+        return -1;
+    }
 
     return 0;
 }
@@ -0,0 +1,501 @@
+#ifndef PARALLEL_TREE_LIB
+#define PARALLEL_TREE_LIB
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "forest.hpp"
+
+namespace forestlib
+{
+
+namespace parallel
+{
+
+// fork-join pool: every worker has its own deque of tasks,
+// takes the newest one of its own and steals the oldest one of the others;
+// the thread calling run is a worker too
+class thread_pool
+{
+    public:
+        using task_t = std::function<void()>;
+
+        explicit thread_pool(unsigned threads = std::thread::hardware_concurrency());
+        ~thread_pool();
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        // workers, the calling one included
+        unsigned size() const noexcept
+        {
+            return static_cast<unsigned>(workers_.size());
+        }
+
+        // runs task and everything spawned from it, returns when all are done
+        // the first exception thrown by a task is rethrown here,
+        // the tasks not started by then are dropped
+        // not to be called from a task
+        void run(task_t task);
+
+        // from a task: queues one more for any worker to take
+        void spawn(task_t task);
+
+        // from a task: some worker has nothing to take,
+        // so it is worth to spawn
+        bool hungry() const noexcept
+        {
+            return idle_.load(std::memory_order_relaxed) > queued_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct worker_t
+        {
+            std::mutex mutex_;
+            std::deque<task_t> tasks_;
+        };
+
+        void work(unsigned self);
+        // takes tasks till there are none left in the run
+        void help(unsigned self);
+        bool take(unsigned self, task_t& task);
+        void execute(task_t& task) noexcept;
+
+        std::vector<std::unique_ptr<worker_t>> workers_;
+        std::vector<std::thread> threads_;
+
+        // tasks spawned and not done yet
+        std::atomic<std::size_t> pending_;
+        // tasks in the deques
+        std::atomic<std::size_t> queued_;
+        // workers that found nothing to take
+        std::atomic<unsigned> idle_;
+
+        std::mutex run_mutex_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        unsigned generation_;
+        bool stop_;
+
+        std::atomic<bool> failed_;
+        std::exception_ptr error_;
+};
+
+// hardware_concurrency workers, made on the first call
+thread_pool& default_pool();
+
+}
+
+namespace detail
+{
+    // src and dst iterators of two forests of the same shape walked as one
+    template<typename Src, typename Dst>
+    struct zip_cursor
+    {
+        using level_t = node_base_t::level_t;
+
+        zip_cursor(Src src, Dst dst) noexcept :
+            src_(src), dst_(dst), level_(src.level_) {}
+
+        zip_cursor& operator++() noexcept
+        {
+            ++src_;
+            ++dst_;
+            level_ = src_.level_;
+            return *this;
+        }
+
+        zip_cursor parent() const noexcept
+        {
+            return zip_cursor(src_.parent(), dst_.parent());
+        }
+
+        bool has_next_sibling() const noexcept
+        {
+            return src_.has_next_sibling();
+        }
+
+        zip_cursor next_sibling() const noexcept
+        {
+            return zip_cursor(src_.next_sibling(), dst_.next_sibling());
+        }
+
+        zip_cursor skip_subtree() const noexcept
+        {
+            return zip_cursor(src_.skip_subtree(), dst_.skip_subtree());
+        }
+
+        friend bool operator==(const zip_cursor& lhs, const zip_cursor& rhs) noexcept
+        {
+            return lhs.src_ == rhs.src_;
+        }
+
+        friend bool operator!=(const zip_cursor& lhs, const zip_cursor& rhs) noexcept
+        {
+            return !(lhs == rhs);
+        }
+
+        Src src_;
+        Dst dst_;
+        level_t level_;
+    };
+
+    // most siblings a task keeps for itself when it splits
+    constexpr std::size_t max_split_keep = 1 << 12;
+
+    // visits first's subtree and those of its next siblings before last
+    // (last is anything off the list, e.g. the parent, for all of them)
+    // in pre-order; while some worker starves, later siblings of the node
+    // at hand are handed off as a task of their own, a split keeps up to
+    // `keep` siblings and the next one (here or in the handed off part)
+    // twice as many, so a long list of small subtrees goes in a few tasks
+    // and a deep one is split at every level; nothing is split along a chain
+    template<typename Cursor, typename Visit>
+    void sweep(parallel::thread_pool& pool, Cursor first, Cursor last, Visit& visit, std::size_t keep = 1)
+    {
+        auto top = first.level_;
+        // handed off lists below the top one, deeper ones last
+        std::vector<Cursor> cuts;
+        for (auto pos = first; pos != last && pos.level_ >= top;)
+        {
+            if (!cuts.empty() && pos == cuts.back())
+            {
+                // the rest of the list is someone else's
+                cuts.pop_back();
+                pos = pos.parent().skip_subtree();
+                continue;
+            }
+
+            if (pool.hungry() && pos.has_next_sibling())
+            {
+                std::size_t found = 0;
+                auto cut = pos;
+                for (auto next = pos; found < keep && next.has_next_sibling(); ++found)
+                {
+                    next = next.next_sibling();
+                    if (next == last || (!cuts.empty() && next == cuts.back()))
+                    {
+                        break;
+                    }
+                    cut = next;
+                }
+
+                if (found < keep && found > 1)
+                {
+                    // the list ends here, half of it goes
+                    cut = pos;
+                    for (std::size_t i = 0; i < (found + 1) / 2; ++i)
+                    {
+                        cut = cut.next_sibling();
+                    }
+                }
+                if (found > 0)
+                {
+                    keep = std::min(2 * keep, max_split_keep);
+                    if (pos.level_ == top)
+                    {
+                        pool.spawn([&pool, cut, last, &visit, keep] { sweep(pool, cut, last, visit, keep); });
+                        last = cut;
+                    }
+                    else if (!cuts.empty() && cuts.back().parent() == cut.parent())
+                    {
+                        // the list is already cut further on,
+                        // the new part ends there and the jump is the same
+                        auto bound = cuts.back();
+                        pool.spawn([&pool, cut, bound, &visit, keep] { sweep(pool, cut, bound, visit, keep); });
+                        cuts.back() = cut;
+                    }
+                    else
+                    {
+                        auto parent = cut.parent();
+                        pool.spawn([&pool, cut, parent, &visit, keep] { sweep(pool, cut, parent, visit, keep); });
+                        cuts.push_back(cut);
+                    }
+                }
+            }
+
+            visit(pos);
+            ++pos;
+        }
+    }
+
+    template<typename Cursor, typename Visit>
+    void parallel_sweep(parallel::thread_pool& pool, Cursor first, Cursor last, Visit visit)
+    {
+        if (first == last)
+        {
+            return;
+        }
+        if (pool.size() == 1)
+        {
+            for (auto pos = first; pos != last; ++pos)
+            {
+                visit(pos);
+            }
+            return;
+        }
+        pool.run([&pool, first, last, &visit] { sweep(pool, first, last, visit); });
+    }
+
+    // fewest nodes worth a block of their own
+    constexpr std::size_t min_fold_block = 1 << 14;
+
+    // bottom-up fold over a forest in pre-order arrays
+    // (subtree of node i is [i, i + sizes[i]), parent of a root is size),
+    // cut into equal blocks of pre-order:
+    // every block folds what it holds in parallel with the others,
+    // then the nodes whose subtrees run over the block's end (open ones,
+    // ancestors of the next block) are finished from the last block back,
+    // taking the children that start in later blocks a group at a time
+    template<typename Value, typename Result, typename Leaf, typename Combine>
+    class subtree_fold
+    {
+        public:
+            subtree_fold(const std::vector<const Value*>& values,
+                         const std::vector<std::size_t>& sizes,
+                         const std::vector<std::size_t>& parents,
+                         std::vector<Result>& results,
+                         Leaf& leaf_fn, Combine& combine_fn, std::size_t blocks) :
+                values_(values), sizes_(sizes), parents_(parents), results_(results),
+                leaf_fn_(leaf_fn), combine_fn_(combine_fn),
+                block_size_((values.size() + blocks - 1) / blocks), blocks_(blocks) {}
+
+            std::size_t blocks() const noexcept
+            {
+                return blocks_.size();
+            }
+
+            void fold_block(std::size_t block_index)
+            {
+                auto size = values_.size();
+                auto first = std::min(block_index * block_size_, size);
+                auto last = std::min(first + block_size_, size);
+                auto& block = blocks_[block_index];
+
+                for (auto i = last; i-- > first;)
+                {
+                    auto acc = leaf_fn_(*values_[i]);
+                    auto end = i + sizes_[i];
+                    auto child = i + 1;
+                    for (; child < end && child + sizes_[child] <= last; child += sizes_[child])
+                    {
+                        acc = combine_fn_(std::move(acc), results_[child]);
+                    }
+                    results_[i] = std::move(acc);
+                    if (end > last)
+                    {
+                        block.open_.push_back({i, child});
+                    }
+                }
+
+                // top nodes of the block, their parents are before it
+                for (auto node = first; node < last && node + sizes_[node] <= last;)
+                {
+                    auto parent = parents_[node];
+                    if (parent == size)
+                    {
+                        node += sizes_[node];
+                        continue;
+                    }
+                    auto group_first = node;
+                    auto partial = results_[node];
+                    for (node += sizes_[node];
+                         node < last && node + sizes_[node] <= last && parents_[node] == parent;
+                         node += sizes_[node])
+                    {
+                        partial = combine_fn_(std::move(partial), results_[node]);
+                    }
+                    block.groups_.push_back({group_first, node, std::move(partial)});
+                }
+            }
+
+            // after every block is folded
+            void finish_open()
+            {
+                for (auto block = blocks_.rbegin(); block != blocks_.rend(); ++block)
+                {
+                    // deeper ones first
+                    for (const auto& open : block->open_)
+                    {
+                        auto acc = std::move(results_[open.node_]);
+                        auto end = open.node_ + sizes_[open.node_];
+                        for (auto child = open.next_child_; child < end;)
+                        {
+                            const auto& groups = blocks_[child / block_size_].groups_;
+                            auto group = std::lower_bound(groups.begin(), groups.end(), child,
+                                                          [] (const group_t& group, std::size_t node)
+                                                          {
+                                                              return group.first_ < node;
+                                                          });
+                            if (group != groups.end() && group->first_ == child)
+                            {
+                                acc = combine_fn_(std::move(acc), group->partial_);
+                                child = group->end_;
+                            }
+                            else
+                            {
+                                // an open one, finished already
+                                acc = combine_fn_(std::move(acc), results_[child]);
+                                child += sizes_[child];
+                            }
+                        }
+                        results_[open.node_] = std::move(acc);
+                    }
+                }
+            }
+
+        private:
+            // children of one parent before the block, next to each other in it
+            struct group_t
+            {
+                std::size_t first_;
+                std::size_t end_;
+                Result partial_;
+            };
+
+            struct open_t
+            {
+                std::size_t node_;
+                // the first child not folded in yet
+                std::size_t next_child_;
+            };
+
+            struct block_t
+            {
+                std::vector<group_t> groups_;
+                std::vector<open_t> open_;
+            };
+
+            const std::vector<const Value*>& values_;
+            const std::vector<std::size_t>& sizes_;
+            const std::vector<std::size_t>& parents_;
+            std::vector<Result>& results_;
+            Leaf& leaf_fn_;
+            Combine& combine_fn_;
+            std::size_t block_size_;
+            std::vector<block_t> blocks_;
+    };
+}
+
+namespace parallel
+{
+
+// fn(value) for every node, in no particular order,
+// called concurrently for different nodes
+// the first exception thrown by fn is rethrown,
+// some of the nodes may be left unvisited then
+template<typename Forest, typename F>
+void for_each(Forest& forest, F fn, thread_pool& pool = default_pool())
+{
+    detail::parallel_sweep(pool, forest.begin(), forest.end(),
+                           [&fn] (auto pos) { fn(*pos); });
+}
+
+// every dst value becomes fn(src value) of the node at the same place,
+// dst must have the shape of src (a copy of it or an earlier result);
+// calls are made as in for_each
+// throws std::invalid_argument if the sizes differ
+template<typename Src, typename Dst, typename F>
+void transform(const Src& src, Dst& dst, F fn, thread_pool& pool = default_pool())
+{
+    if (src.size() != dst.size())
+    {
+        throw std::invalid_argument("forest: transform to a forest of another shape");
+    }
+
+    using cursor_t = detail::zip_cursor<decltype(src.begin()), decltype(dst.begin())>;
+    detail::parallel_sweep(pool, cursor_t(src.begin(), dst.begin()), cursor_t(src.end(), dst.end()),
+                           [&fn] (const cursor_t& pos) { *pos.dst_ = fn(*pos.src_); });
+}
+
+// result of every node in pre-order:
+// leaf_fn(value) folded with the results of its children, left to right,
+// by acc = combine_fn(acc, child result)
+// combine_fn must be associative: children may be combined in groups first,
+// the results are the same for any number of threads then;
+// both are called concurrently for different nodes
+// the pre-order arrays are gathered in one sequential sweep,
+// small forests (or a pool of one) are folded on the calling thread
+template<typename Forest, typename Leaf, typename Combine>
+auto reduce_subtrees(const Forest& forest, Leaf leaf_fn, Combine combine_fn,
+                     thread_pool& pool = default_pool())
+{
+    using value_t = std::decay_t<decltype(*forest.begin())>;
+    using result_t = std::decay_t<std::invoke_result_t<Leaf&, const value_t&>>;
+    static_assert(std::is_default_constructible_v<result_t>, "forest: results must be default constructible");
+    static_assert(!std::is_same_v<result_t, bool>, "forest: bool results would share bytes");
+
+    auto size = forest.size();
+    std::vector<result_t> results(size);
+    std::vector<std::size_t> sizes(size);
+    std::vector<std::size_t> parents(size);
+    auto blocks = pool.size() == 1 ? 1 :
+                  std::min<std::size_t>((size + detail::min_fold_block - 1) / detail::min_fold_block,
+                                        8 * pool.size());
+
+    // visit(index, pos) on every node, sizes and parents on the way
+    auto gather = [&forest, &sizes, &parents, size] (auto visit)
+    {
+        // open nodes on every level
+        std::vector<std::size_t> path;
+        std::size_t index = 0;
+        for (auto it = forest.begin(); it != forest.end(); ++it, ++index)
+        {
+            for (auto level = forest.get_level(it); path.size() >= level; path.pop_back())
+            {
+                sizes[path.back()] = index - path.back();
+            }
+            parents[index] = path.empty() ? size : path.back();
+            path.push_back(index);
+            visit(index, it);
+        }
+        for (; !path.empty(); path.pop_back())
+        {
+            sizes[path.back()] = size - path.back();
+        }
+    };
+
+    if (blocks <= 1)
+    {
+        // leaves on the way, the nodes are not walked twice
+        gather([&results, &leaf_fn] (std::size_t index, auto pos) { results[index] = leaf_fn(*pos); });
+        for (auto i = size; i-- > 0;)
+        {
+            for (auto child = i + 1; child < i + sizes[i]; child += sizes[child])
+            {
+                results[i] = combine_fn(std::move(results[i]), results[child]);
+            }
+        }
+        return results;
+    }
+
+    std::vector<const value_t*> values(size);
+    gather([&values] (std::size_t index, auto pos) { values[index] = std::addressof(*pos); });
+    detail::subtree_fold<value_t, result_t, Leaf, Combine> fold(values, sizes, parents, results,
+                                                               leaf_fn, combine_fn, blocks);
+    pool.run([&pool, &fold]
+    {
+        for (std::size_t block = 0; block < fold.blocks(); ++block)
+        {
+            pool.spawn([&fold, block] { fold.fold_block(block); });
+        }
+    });
+    fold.finish_open();
+    return results;
+}
+
+}
+
+} //forest
+#endif //PARALLEL_TREE_LIB
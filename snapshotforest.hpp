@@ -0,0 +1,185 @@
+#ifndef SNAPSHOT_TREE_LIB
+#define SNAPSHOT_TREE_LIB
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "forest.hpp"
+#include "frozenforest.hpp"
+
+namespace forestlib
+{
+
+namespace detail
+{
+    // epoch based reclamation: a reader pins the epoch it starts in,
+    // a retired object goes once no pinned epoch is as old as its retirement
+    class epoch_domain
+    {
+        public:
+            // readers at once, one more waits for a free slot
+            static constexpr std::size_t slots = 64;
+
+            using deleter_t = void (*)(void*);
+
+            epoch_domain() noexcept;
+            // frees all retired ones, nobody may be reading
+            ~epoch_domain();
+
+            epoch_domain(const epoch_domain&) = delete;
+            epoch_domain& operator=(const epoch_domain&) = delete;
+
+            // lock-free, the slot is for leave
+            std::size_t enter() noexcept;
+            void leave(std::size_t slot) noexcept;
+
+            // room for one more retire, so that it can not fail
+            void reserve();
+            // object is unpublished already, readers that came before may still see it;
+            // calls to reserve, retire and reclaim must not overlap
+            void retire(void* object, deleter_t deleter) noexcept;
+            // frees what no reader can see any more
+            void reclaim() noexcept;
+
+        private:
+            static constexpr std::uint64_t idle = 0;
+
+            // one per cache line
+            struct alignas(64) slot_t
+            {
+                std::atomic<std::uint64_t> epoch_;
+            };
+
+            struct retired_t
+            {
+                void* object_;
+                deleter_t deleter_;
+                std::uint64_t epoch_;
+            };
+
+            slot_t slots_[slots];
+            std::atomic<std::uint64_t> epoch_;
+            std::vector<retired_t> retired_;
+    };
+}
+
+// forest for one writer and any number of readers:
+// the writer changes the draft and publishes it as an immutable version,
+// readers walk the version they got without locks,
+// an old version is freed after the last reader that could see it is done;
+// publishing freezes the whole draft, so it is O(n) and worth batching
+template<typename T>
+class snapshot_forest
+{
+    public:
+        using version_t = frozen_forest<T>;
+
+        // keeps the version it was made with alive
+        class reader
+        {
+            public:
+                reader(reader&& rhs) noexcept :
+                    domain_(rhs.domain_), slot_(rhs.slot_), version_(rhs.version_)
+                {
+                    rhs.domain_ = nullptr;
+                }
+
+                reader& operator=(reader&&) = delete;
+
+                ~reader()
+                {
+                    if (domain_)
+                    {
+                        domain_->leave(slot_);
+                    }
+                }
+
+                const version_t& operator*() const noexcept
+                {
+                    return *version_;
+                }
+
+                const version_t* operator->() const noexcept
+                {
+                    return version_;
+                }
+
+            private:
+                friend class snapshot_forest;
+
+                reader(detail::epoch_domain* domain, const std::atomic<const version_t*>& current) noexcept :
+                    domain_(domain), slot_(domain->enter()), version_(current.load())
+                {
+                }
+
+                detail::epoch_domain* domain_;
+                std::size_t slot_;
+                const version_t* version_;
+        };
+
+        snapshot_forest() :
+            current_(new version_t()) {}
+
+        // starts with a copy of src published
+        explicit snapshot_forest(const forest<T>& src) :
+            draft_(src), current_(new version_t(src)) {}
+
+        snapshot_forest(const snapshot_forest&) = delete;
+        snapshot_forest& operator=(const snapshot_forest&) = delete;
+
+        // no reader may be left
+        ~snapshot_forest()
+        {
+            delete current_.load();
+        }
+
+        // any thread, lock-free
+        reader read() const noexcept
+        {
+            return reader(&domain_, current_);
+        }
+
+        // the writer's own forest, not seen by readers till published
+        forest<T>& draft() noexcept
+        {
+            return draft_;
+        }
+
+        const forest<T>& draft() const noexcept
+        {
+            return draft_;
+        }
+
+        // makes the draft the version new readers get
+        void publish()
+        {
+            std::unique_ptr<version_t> next(new version_t(draft_));
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            domain_.reserve();
+            auto previous = current_.exchange(next.release());
+            domain_.retire(const_cast<version_t*>(previous),
+                           [] (void* version) { delete static_cast<version_t*>(version); });
+            domain_.reclaim();
+        }
+
+        // frees the versions no reader holds, publish does it too
+        void reclaim() noexcept
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            domain_.reclaim();
+        }
+
+    private:
+        forest<T> draft_;
+        std::atomic<const version_t*> current_;
+        mutable detail::epoch_domain domain_;
+        std::mutex writer_mutex_;
+};
+
+} //forest
+#endif //SNAPSHOT_TREE_LIB